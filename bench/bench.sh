@@ -0,0 +1,90 @@
+#!/bin/bash
+#
+# times the compilers on the inputs of gen.sh, and compares them with baseline.txt.
+# the time is the sum of the phases reported by --stats (the process start is not included),
+# the best of $RUNS runs; lines/s counts the lines of the .c only, tokens/s the included ones too.
+#
+# usage: bench/bench.sh [--save] [compiler]...
+#   --save : write the results to baseline.txt instead of comparing with it
+#   compiler : gen1, gen2 or gen3 (default: each one built)
+
+cd $(dirname $BASH_SOURCE)
+
+OUT=out
+BASELINE=baseline.txt
+RUNS=${RUNS:-3}
+SCALE=${SCALE:-1}
+INPUTS="functions expr switch globals macros includes"
+
+SAVE=0
+if [ "$1" = "--save" ]; then
+    SAVE=1
+    shift
+fi
+
+declare -A BIN=([gen1]=../bin/rcc [gen2]=../bin/rcc2 [gen3]=../bin/rcc3)
+GENS="$@"
+if [ -z "$GENS" ]; then
+    for g in gen1 gen2 gen3; do
+        [ -x ${BIN[$g]} ] && GENS="$GENS $g"
+    done
+fi
+
+./gen.sh $OUT $SCALE
+
+# value of a number in the JSON of --stats
+function stat {
+    echo "$2" | grep -o "\"$1\":[0-9]*" | cut -d: -f2
+}
+
+# the baseline of a gen and an input: tokens/s and rss
+function baseline {
+    [ -f $BASELINE ] && grep "^$1 $2 " $BASELINE | cut -d' ' -f4,6
+}
+
+# ratio of $1 to $2 as x.xx
+function ratio {
+    local r=$(( $1 * 100 / $2 ))
+    printf "x%d.%02d" $((r / 100)) $((r % 100))
+}
+
+RESULTS=""
+printf "%-5s %-10s %7s %8s %9s %10s %11s %8s  %s\n" gen input lines tokens "time(ms)" lines/s tokens/s rss_kb "vs baseline (tokens/s, rss)"
+for g in $GENS; do
+    for input in $INPUTS; do
+        src=$OUT/$input.c
+        lines=$(wc -l < $src)
+        best=0
+        for ((i=0; i<RUNS; i++)); do
+            json=$(${BIN[$g]} --stats=json -S -I../include -I$OUT/include -o $OUT/$input.s $src 2>&1 >/dev/null | grep '^{')
+            if [ -z "$json" ]; then
+                echo "$g failed to compile $src" >&2
+                exit 1
+            fi
+            us=$(stat total_us "$json")
+            if [ $best -eq 0 ] || [ $us -lt $best ]; then
+                best=$us
+            fi
+        done
+        tokens=$(stat tokens "$json")
+        rss=$(stat peak_rss_kb "$json")
+        lines_per_s=$(( lines * 1000000 / best ))
+        tokens_per_s=$(( tokens * 1000000 / best ))
+
+        compared=""
+        base=($(baseline $g $input))
+        if [ ${#base[@]} -eq 2 ]; then
+            compared="$(ratio $tokens_per_s ${base[0]}), $(ratio $rss ${base[1]})"
+        fi
+        printf "%-5s %-10s %7d %8d %9d.%d %10d %11d %8d  %s\n" $g $input $lines $tokens $((best / 1000)) $((best % 1000 / 100)) $lines_per_s $tokens_per_s $rss "$compared"
+        RESULTS="$RESULTS$g $input $lines_per_s $tokens_per_s $lines $rss\n"
+    done
+done
+
+if [ $SAVE -eq 1 ]; then
+    {
+        echo "# gen input lines/s tokens/s lines rss_kb -- by bench/bench.sh --save on $(nproc) cpu(s), scale $SCALE"
+        printf "$RESULTS"
+    } > $BASELINE
+    echo "saved to bench/$BASELINE"
+fi
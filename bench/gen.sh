@@ -0,0 +1,237 @@
+#!/bin/bash
+#
+# generates the inputs of the compile benchmark into <dir>, in the subset of C rcc supports.
+# the output depends only on <scale> (default 1, about 20k lines per input)
+#
+#   functions.c : many small functions calling each other
+#   expr.c      : deeply nested arithmetic and logical expressions
+#   switch.c    : functions made of big switch statements
+#   globals.c   : many global variables and initialized arrays
+#   macros.c    : function-like macros expanded in every statement
+#   includes.c  : a tree of guarded headers, each included many times
+#
+# usage: bench/gen.sh <dir> [scale]
+
+DIR=$1
+SCALE=${2:-1}
+if [ -z "$DIR" ]; then
+    echo "usage: $0 <dir> [scale]" >&2
+    exit 1
+fi
+mkdir -p $DIR/include
+
+# a linear congruential generator, so that the inputs are the same everywhere
+SEED=12345
+function rand {
+    SEED=$(( (SEED * 1103515245 + 12345) % 2147483648 ))
+    R=$(( SEED / 65536 % $1 ))
+}
+
+function gen_functions {
+    local n=$((1000 * SCALE))
+    echo "extern int printf(char *fmt, ...);"
+    for ((i=0; i<n; i++)); do
+        echo "int f$i(int a, int b);"
+    done
+    for ((i=0; i<n; i++)); do
+        rand $((i + 1))
+        cat <<EOF
+int f$i(int a, int b) {
+    int x = a + $i;
+    int y = b - a;
+    if (a <= 0) {
+        return x + y;
+    }
+    for (int k=0; k<3; k++) {
+        x = x * 3 + k;
+        y = y ^ x;
+    }
+    while (y > 100) {
+        y = y / 2;
+    }
+    if (x % 7 == 3) {
+        x = f$R(a - 1, b);
+    }
+    return x + y;
+}
+EOF
+    done
+    echo "int main() {"
+    echo "    printf(\"%d\\n\", f$((n - 1))(3, 4));"
+    echo "    return 0;"
+    echo "}"
+}
+
+# a random expression of depth $1 over a, b, c
+function expr {
+    if [ $1 -eq 0 ]; then
+        rand 4
+        case $R in
+            0) E="a";; 1) E="b";; 2) E="c";; 3) rand 100; E="$R";;
+        esac
+        return
+    fi
+    local d=$(($1 - 1))
+    expr $d
+    local l=$E
+    expr $d
+    local r=$E
+    rand 8
+    case $R in
+        0) E="($l + $r)";; 1) E="($l - $r)";; 2) E="($l * $r)";; 3) E="($l & $r)";;
+        4) E="($l | $r)";; 5) E="($l ^ $r)";; 6) E="($l < $r)";; 7) E="($l == $r)";;
+    esac
+}
+
+function gen_expr {
+    local n=$((600 * SCALE))
+    echo "extern int printf(char *fmt, ...);"
+    for ((i=0; i<n; i++)); do
+        echo "int e$i(int a, int b, int c) {"
+        for ((j=0; j<4; j++)); do
+            expr 4
+            echo "    a = $E;"
+            echo "    if ((a + b) && (b - c) || !(a * c)) {"
+            echo "        b = b + 1;"
+            echo "    }"
+            echo "    c = c + (a << 2) - (b >> 1) + (a % 5 == 1 ? a : b);"
+        done
+        echo "    return a + b + c;"
+        echo "}"
+    done
+    echo "int main() {"
+    echo "    printf(\"%d\\n\", e0(1, 2, 3));"
+    echo "    return 0;"
+    echo "}"
+}
+
+function gen_switch {
+    local n=$((50 * SCALE))
+    echo "extern int printf(char *fmt, ...);"
+    echo "enum op { OP_NOP, OP_HALT = 200 };"
+    for ((i=0; i<n; i++)); do
+        echo "int s$i(int op, int x) {"
+        echo "    switch (op) {"
+        for ((j=0; j<100; j++)); do
+            echo "    case $j:"
+            rand 4
+            case $R in
+                0) echo "        x = x + $j;";;
+                1) echo "        x = x * $((j % 7 + 1));";;
+                2) echo "        if (x > $j) { x = x - $j; }";;
+                3) echo "        x = x ^ $j;";;
+            esac
+            echo "        break;"
+        done
+        echo "    case OP_HALT:"
+        echo "        return -1;"
+        echo "    default:"
+        echo "        x = 0;"
+        echo "    }"
+        echo "    return x;"
+        echo "}"
+    done
+    echo "int main() {"
+    echo "    printf(\"%d\\n\", s0(7, 3));"
+    echo "    return 0;"
+    echo "}"
+}
+
+function gen_globals {
+    local n=$((2000 * SCALE))
+    echo "extern int printf(char *fmt, ...);"
+    for ((i=0; i<n; i++)); do
+        echo "int g$i;"
+        echo "long gl$i = $i;"
+        echo "char *gs$i = \"global string $i\";"
+        echo "int ga$i[4] = {$i, $((i + 1)), $((i + 2)), $((i + 3))};"
+    done
+    echo "int sum() {"
+    echo "    int s = 0;"
+    for ((i=0; i<n; i++)); do
+        echo "    s = s + g$i + ga$i[$((i % 4))];"
+        echo "    g$i = s;"
+    done
+    echo "    return s;"
+    echo "}"
+    echo "int main() {"
+    echo "    printf(\"%d %s\\n\", sum(), gs0);"
+    echo "    return 0;"
+    echo "}"
+}
+
+function gen_macros {
+    local n=$((400 * SCALE))
+    echo "extern int printf(char *fmt, ...);"
+    echo "#define MAX(a, b) ((a) > (b) ? (a) : (b))"
+    echo "#define MIN(a, b) ((a) < (b) ? (a) : (b))"
+    echo "#define CLAMP(x, lo, hi) MIN(MAX(x, lo), hi)"
+    echo "#define SQ(x) ((x) * (x))"
+    echo "#define LIMIT 1000"
+    echo "#define STEP(x, y) x = CLAMP(x + SQ(y), -LIMIT, LIMIT)"
+    echo "#define CAT(a, b) a ## b"
+    echo "#define FN(n) CAT(m, n)"
+    for ((i=0; i<n; i++)); do
+        echo "int FN($i)(int a, int b) {"
+        for ((j=0; j<8; j++)); do
+            echo "    STEP(a, b);"
+            echo "    b = MAX(a, b) - MIN(a, SQ(b)) + LIMIT;"
+        done
+        echo "    return a + b;"
+        echo "}"
+    done
+    echo "int main() {"
+    echo "    printf(\"%d\\n\", m0(1, 2));"
+    echo "    return 0;"
+    echo "}"
+}
+
+# headers h0..h39, each including the next two, with a struct, a macro and prototypes
+function gen_headers {
+    local n=40
+    for ((i=0; i<n; i++)); do
+        local f=$DIR/include/h$i.h
+        {
+            echo "#ifndef H${i}_H"
+            echo "#define H${i}_H"
+            for ((j=i+1; j<=i+2 && j<n; j++)); do
+                echo "#include \"h$j.h\""
+            done
+            echo "typedef struct {"
+            echo "    long value;"
+            echo "    char *name;"
+            echo "    long id;"
+            echo "} h${i}_t;"
+            echo "#define H${i}_VALUE(p) ((p)->value + $i)"
+            for ((j=0; j<100; j++)); do
+                echo "int h${i}_f$j(h${i}_t *p, int x);"
+            done
+            echo "extern int h${i}_count;"
+            echo "#endif"
+        } > $f
+    done
+}
+
+function gen_includes {
+    local n=$((200 * SCALE))
+    echo "extern int printf(char *fmt, ...);"
+    for ((i=0; i<n; i++)); do
+        rand 40
+        echo "#include \"h$R.h\""
+        echo "long i$i(h${R}_t *p) {"
+        echo "    return H${R}_VALUE(p) * $i;"
+        echo "}"
+    done
+    echo "int main() {"
+    echo "    printf(\"%d\\n\", sizeof(h0_t));"
+    echo "    return 0;"
+    echo "}"
+}
+
+gen_functions > $DIR/functions.c
+gen_expr > $DIR/expr.c
+gen_switch > $DIR/switch.c
+gen_globals > $DIR/globals.c
+gen_macros > $DIR/macros.c
+gen_headers
+gen_includes > $DIR/includes.c
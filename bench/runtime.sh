@@ -0,0 +1,117 @@
+#!/bin/bash
+#
+# times the code generated by rcc against gcc -O0 and gcc -O2 on the programs of runtime/,
+# and compares it with runtime_baseline.txt.
+# each program is linked with test/print.c like the tests, and the outputs of the three
+# builds must be the same. the time is the wall time of the program, the best of $RUNS runs;
+# text is the size of the .text section of the program's own object.
+#
+# usage: bench/runtime.sh [--save] [program]...
+#   --save : write the results to runtime_baseline.txt instead of comparing with it
+#   program : a name in runtime/ without .c (default: all of them)
+
+cd $(dirname $BASH_SOURCE)
+
+OUT=out/runtime
+BASELINE=runtime_baseline.txt
+RUNS=${RUNS:-3}
+RCC=${RCC:-../bin/rcc}
+GCC=gcc
+PRINT=../test/print.c
+
+SAVE=0
+if [ "$1" = "--save" ]; then
+    SAVE=1
+    shift
+fi
+
+PROGRAMS="$@"
+if [ -z "$PROGRAMS" ]; then
+    PROGRAMS=$(cd runtime; ls *.c | sed 's/\.c$//')
+fi
+
+mkdir -p $OUT
+
+function fail {
+    echo "$1" >&2
+    exit 1
+}
+
+# builds $OUT/<name>.<build> and its object for the size, from runtime/<name>.c
+function build {
+    local src=runtime/$1.c
+    local bin=$OUT/$1.$2
+    case $2 in
+        rcc)
+            $RCC -S -I../include -o $bin.s $src 2>$bin.log || fail "$RCC failed to compile $src: see bench/$bin.log"
+            $GCC -c -o $bin.o $bin.s && $GCC -o $bin $bin.s $PRINT 2>/dev/null;;
+        O0|O2)
+            $GCC -$2 -w -c -o $bin.o $src && $GCC -$2 -w -o $bin $src $PRINT;;
+    esac || fail "cannot build $bin"
+}
+
+# the best wall time of $1 in ms as x.x
+function best_time {
+    local best=0
+    for ((i=0; i<RUNS; i++)); do
+        local start=$(date +%s%N)
+        $1 > /dev/null
+        local us=$(( ($(date +%s%N) - start) / 1000 ))
+        if [ $best -eq 0 ] || [ $us -lt $best ]; then
+            best=$us
+        fi
+    done
+    echo $best
+}
+
+function text_size {
+    size -A $1 | awk '$1 == ".text" { print $2 }'
+}
+
+# the baseline of a program: rcc time in us and rcc text size
+function baseline {
+    [ -f $BASELINE ] && grep "^$1 " $BASELINE | cut -d' ' -f2,3
+}
+
+# ratio of $1 to $2 as x.xx
+function ratio {
+    local r=$(( $1 * 100 / $2 ))
+    printf "x%d.%02d" $((r / 100)) $((r % 100))
+}
+
+function ms {
+    printf "%d.%d" $(($1 / 1000)) $(($1 % 1000 / 100))
+}
+
+RESULTS=""
+printf "%-8s %9s %9s %9s %7s %7s %7s %7s %7s  %s\n" program rcc_ms O0_ms O2_ms rcc/O0 rcc/O2 text text_O0 text_O2 "vs baseline (time, text)"
+for p in $PROGRAMS; do
+    [ -f runtime/$p.c ] || fail "no such program: runtime/$p.c"
+    declare -A US TEXT
+    for b in rcc O0 O2; do
+        build $p $b
+        $OUT/$p.$b > $OUT/$p.$b.txt
+        if [ $b != rcc ]; then
+            diff -q $OUT/$p.rcc.txt $OUT/$p.$b.txt > /dev/null || fail "$p: the output of rcc differs from gcc -$b"
+        fi
+        US[$b]=$(best_time $OUT/$p.$b)
+        TEXT[$b]=$(text_size $OUT/$p.$b.o)
+    done
+
+    compared=""
+    base=($(baseline $p))
+    if [ ${#base[@]} -eq 2 ]; then
+        compared="$(ratio ${US[rcc]} ${base[0]}), $(ratio ${TEXT[rcc]} ${base[1]})"
+    fi
+    printf "%-8s %9s %9s %9s %7s %7s %7d %7d %7d  %s\n" $p $(ms ${US[rcc]}) $(ms ${US[O0]}) $(ms ${US[O2]}) \
+        $(ratio ${US[rcc]} ${US[O0]}) $(ratio ${US[rcc]} ${US[O2]}) ${TEXT[rcc]} ${TEXT[O0]} ${TEXT[O2]} "$compared"
+    RESULTS="$RESULTS$p ${US[rcc]} ${TEXT[rcc]} ${US[O0]} ${US[O2]}\n"
+done
+
+if [ $SAVE -eq 1 ]; then
+    {
+        echo "# program rcc_us rcc_text O0_us O2_us -- by bench/runtime.sh --save on $(nproc) cpu(s)"
+        printf "$RESULTS"
+    } > $BASELINE
+    echo "saved to bench/$BASELINE"
+fi
@@ -0,0 +1,16 @@
+/*
+ * recursive calls
+ */
+extern void print(int d);
+
+int fib(int n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main() {
+    print(fib(35));
+    return 0;
+}
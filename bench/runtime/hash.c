@@ -0,0 +1,46 @@
+/*
+ * string building and hashing, char by char
+ */
+extern void print(int d);
+
+#define LEN 64
+#define TABLE 4096
+
+char buf[LEN + 1];
+int table[TABLE];
+
+void make_key(int n) {
+    for (int i=0; i<LEN; i++) {
+        buf[i] = 'a' + (n + i * 7) % 26;
+    }
+    buf[LEN] = '\0';
+}
+
+int hash(char *s) {
+    int h = 5381;
+    while (*s) {
+        int c = *s;
+        h = ((h << 5) + h + (c & 255)) & 0x7fffffff;
+        s++;
+    }
+    return h;
+}
+
+int main() {
+    int check = 0;
+    for (int n=0; n<300000; n++) {
+        make_key(n);
+        int h = hash(buf);
+        table[h % TABLE]++;
+        check = check ^ h;
+    }
+    int used = 0;
+    for (int i=0; i<TABLE; i++) {
+        if (table[i]) {
+            used++;
+        }
+    }
+    print(check);
+    print(used);
+    return 0;
+}
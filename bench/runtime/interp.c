@@ -0,0 +1,103 @@
+/*
+ * a switch-heavy bytecode interpreter loop
+ */
+extern void print(int d);
+
+enum op {
+    OP_PUSH,
+    OP_LOAD,
+    OP_STORE,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_MOD,
+    OP_DUP,
+    OP_JNZ,
+    OP_HALT
+};
+
+int code[64];
+int stack[64];
+int vars[4];
+
+/*
+ * sum = 0; n = 3000000; do { sum = (sum + n * 7) % 1000003; n = n - 1; } while (n);
+ */
+int load() {
+    int p = 0;
+    code[p++] = OP_PUSH; code[p++] = 0;
+    code[p++] = OP_STORE; code[p++] = 0;
+    code[p++] = OP_PUSH; code[p++] = 3000000;
+    code[p++] = OP_STORE; code[p++] = 1;
+    int loop = p;
+    code[p++] = OP_LOAD; code[p++] = 0;
+    code[p++] = OP_LOAD; code[p++] = 1;
+    code[p++] = OP_PUSH; code[p++] = 7;
+    code[p++] = OP_MUL;
+    code[p++] = OP_ADD;
+    code[p++] = OP_PUSH; code[p++] = 1000003;
+    code[p++] = OP_MOD;
+    code[p++] = OP_STORE; code[p++] = 0;
+    code[p++] = OP_LOAD; code[p++] = 1;
+    code[p++] = OP_PUSH; code[p++] = 1;
+    code[p++] = OP_SUB;
+    code[p++] = OP_DUP;
+    code[p++] = OP_STORE; code[p++] = 1;
+    code[p++] = OP_JNZ; code[p++] = loop;
+    code[p++] = OP_HALT;
+    return p;
+}
+
+int run() {
+    int pc = 0;
+    int sp = 0;
+    for (;;) {
+        int op = code[pc++];
+        switch (op) {
+            case OP_PUSH:
+                stack[sp++] = code[pc++];
+                break;
+            case OP_LOAD:
+                stack[sp++] = vars[code[pc++]];
+                break;
+            case OP_STORE:
+                vars[code[pc++]] = stack[--sp];
+                break;
+            case OP_ADD:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] + stack[sp];
+                break;
+            case OP_SUB:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] - stack[sp];
+                break;
+            case OP_MUL:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] * stack[sp];
+                break;
+            case OP_MOD:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] % stack[sp];
+                break;
+            case OP_DUP:
+                stack[sp] = stack[sp - 1];
+                sp++;
+                break;
+            case OP_JNZ:
+                if (stack[--sp]) {
+                    pc = code[pc];
+                } else {
+                    pc++;
+                }
+                break;
+            case OP_HALT:
+                return vars[0];
+        }
+    }
+}
+
+int main() {
+    load();
+    print(run());
+    return 0;
+}
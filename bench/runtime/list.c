@@ -0,0 +1,72 @@
+/*
+ * struct pointers: building, sorting and walking linked lists
+ */
+extern void print(int d);
+extern void *malloc(long size);
+
+#define NULL ((void *)0)
+
+typedef struct node {
+    int key;
+    int value;
+    struct node *next;
+} node_t;
+
+node_t *push(node_t *head, int key) {
+    long size = sizeof(node_t);
+    node_t *n = malloc(size);
+    n->key = key;
+    n->value = key * 3;
+    n->next = head;
+    return n;
+}
+
+/*
+ * insertion into a sorted list
+ */
+node_t *insert(node_t *sorted, node_t *n) {
+    if (!sorted || n->key < sorted->key) {
+        n->next = sorted;
+        return n;
+    }
+    node_t *p = sorted;
+    while (p->next && p->next->key <= n->key) {
+        p = p->next;
+    }
+    n->next = p->next;
+    p->next = n;
+    return sorted;
+}
+
+node_t *sort(node_t *list) {
+    node_t *sorted = NULL;
+    while (list) {
+        node_t *next = list->next;
+        sorted = insert(sorted, list);
+        list = next;
+    }
+    return sorted;
+}
+
+int main() {
+    int check = 0;
+    for (int r=0; r<4; r++) {
+        node_t *list = NULL;
+        int seed = r + 1;
+        for (int i=0; i<5000; i++) {
+            seed = (seed * 1103 + 12345) % 65536;
+            list = push(list, seed);
+        }
+        list = sort(list);
+        int prev = -1;
+        for (node_t *p = list; p; p = p->next) {
+            if (p->key < prev) {
+                check = -1;
+            }
+            prev = p->key;
+            check = (check * 31 + p->value) % 1000003;
+        }
+    }
+    print(check);
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * nested loops over int arrays
+ */
+extern void print(int d);
+
+#define N 160
+
+int a[N * N];
+int b[N * N];
+int c[N * N];
+
+void init() {
+    for (int i=0; i<N; i++) {
+        for (int j=0; j<N; j++) {
+            a[i * N + j] = (i + j) % 17 - 8;
+            b[i * N + j] = (i * j) % 13 - 6;
+        }
+    }
+}
+
+void multiply() {
+    for (int i=0; i<N; i++) {
+        for (int j=0; j<N; j++) {
+            int sum = 0;
+            for (int k=0; k<N; k++) {
+                sum = sum + a[i * N + k] * b[k * N + j];
+            }
+            c[i * N + j] = sum;
+        }
+    }
+}
+
+int main() {
+    init();
+    for (int r=0; r<8; r++) {
+        multiply();
+    }
+    int check = 0;
+    for (int i=0; i<N * N; i++) {
+        check = check ^ (c[i] + i);
+    }
+    print(check);
+    return 0;
+}
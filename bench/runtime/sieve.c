@@ -0,0 +1,33 @@
+/*
+ * byte array loops
+ */
+extern void print(int d);
+
+#define N 1000000
+
+char flags[N + 1];
+
+int sieve() {
+    int count = 0;
+    for (int i=2; i<=N; i++) {
+        flags[i] = 1;
+    }
+    for (int i=2; i<=N; i++) {
+        if (flags[i]) {
+            count++;
+            for (int j=i+i; j<=N; j=j+i) {
+                flags[j] = 0;
+            }
+        }
+    }
+    return count;
+}
+
+int main() {
+    int count = 0;
+    for (int i=0; i<20; i++) {
+        count = sieve();
+    }
+    print(count);
+    return 0;
+}
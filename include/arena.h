@@ -0,0 +1,21 @@
+/*
+ * arena - bump allocator for objects that live until the end of the compilation.
+ *
+ * Memory is taken from chunks of ARENA_CHUNK_SIZE bytes; each allocation is zero-cleared
+ * and 8-byte aligned. There is no per-object free: everything is released at once by
+ * arena_release(). Allocations larger than a quarter chunk get a chunk of their own.
+ * The arena belongs to the current context (see context.h), and is released with it.
+ *
+ * arena_realloc() moves a block to a larger one, leaving the old one unused in the arena;
+ * the last allocated block grows in place instead if its chunk has room, and a block with a
+ * chunk of its own is reallocated. The grown part is not cleared, and the old size must be
+ * the size the block was allocated with.
+ */
+#define ARENA_CHUNK_SIZE (1024*1024)
+
+extern void *arena_alloc(long size);
+extern void *arena_realloc(void *p, long old_size, long new_size);
+extern char *arena_strdup(const char *str);
+extern void arena_release();
+extern long arena_allocated();
+extern int arena_chunk_count();
@@ -70,9 +70,20 @@ typedef struct {
     int token_pos;
 } atom_t;
 
-extern atom_t program[];
+/*
+ * the atom pool grows by chunks of ATOM_CHUNK_SIZE atoms. atom_at(pos) returns the atom at pos;
+ * atoms allocated together by alloc_atom(size) are contiguous, so (p+1), (p+2), ... are valid.
+ * atom_release(mark) gives back the atoms allocated after atom_mark(); atom_count() is the peak in use.
+ */
+#define ATOM_CHUNK_BITS 12
+#define ATOM_CHUNK_SIZE (1 << ATOM_CHUNK_BITS)
 
+atom_t *atom_at(int pos);
 int alloc_atom(int size);
+int atom_mark();
+void atom_release(int mark);
+int atom_count();
+int atom_chunk_count();
 
 void dump_atom(int pos, int);
 void dump_atom2(atom_t *a, int, int);
@@ -80,6 +91,7 @@ void dump_atom3(char *, atom_t *a, int, int);
 void dump_atom_all();
 void dump_atom_tree(int, int);
 
+void build_int_atom(int pos, int type, int value);
 void build_pos_atom(int pos, int type, int value);
 
 int atom_to_rvalue(int);
@@ -0,0 +1,168 @@
+/*
+ * context.h
+ *
+ * All the state of one compilation, so that compilations can be interleaved or repeated in
+ * one process. ctx points to the current context; the modules read and write their state
+ * through it. Everything a context allocates comes from its own arena (and the files it maps),
+ * so context_free() releases a whole compilation at once.
+ *
+ * - context_new() : returns a new context in the initial state
+ * - context_use(c) : makes c the current context. returns the previous one
+ * - context_free(c) : releases c and everything allocated in it. if c is current, none is afterwards
+ *
+ * Objects of a context must only be touched while it is current. ctx is thread-local when
+ * built by gcc, so threads may run compilations of their own contexts concurrently.
+ *
+ * include vec.h, map.h, token.h, file.h, type.h, var.h, func.h, atom.h, gstr.h, macro.h,
+ * pch.h and emit.h before this header.
+ */
+typedef struct {
+    // devtool.c
+    long *error_exit;     // jmp_buf that error() returns to instead of exiting, set by rcc_compile() and the server
+    char *error_message;
+
+    // arena.c
+    char *arena_chunks;  // every chunk starts with a link to the previously allocated chunk
+    char *arena_top;     // chunk currently bumped from
+    long arena_pos;
+    long arena_total;
+    int arena_chunks_len;
+    int arena_heap_calls;  // calloc and realloc calls for the chunks
+
+    // stats.c
+    int stats;                     // STATS_NONE, STATS_TEXT or STATS_JSON
+    char_p_vec stats_phase_names;
+    int_vec stats_phase_times;     // in microseconds
+
+    // trace.c
+    int trace_fd;      // 0 unless tracing
+    int trace_pid;
+    char *trace_buf;   // events not written yet
+    int trace_len;
+
+    // intern.c
+    str_map interned;
+
+    // file.c
+    src_t *src;
+    src_vec srcs;
+    int_vec src_id_stack;
+    char_p_vec include_dirs;
+    str_map include_paths;   // include name -> resolved path; the include dirs do not change after the root file is entered
+    str_map include_guards;  // resolved path -> the guard macro of the file, or "" for '#pragma once'
+    vec mapped_bodies;       // files mapped by map_file(), unmapped by context_free()
+    int_vec mapped_lens;
+    str_map memory_files;    // path -> memory_file_t, read instead of the file
+    void *include_resolver;  // rcc_include_resolver_t of rcc_compile()
+    void *include_resolver_data;
+
+    // token.c
+    bool_vec ifdef_skips;
+    token_vec tokens;
+    int token_pos;
+    char_p_vec macro_params;  // parameter names of the macro being defined
+    char *ifndef_name;        // the name tested by the last #ifndef
+    int includes;             // includes entered, the guarded ones skipped not counted
+    char **keyword_names;
+    token_id *keyword_ids;
+
+    // macro.c
+    str_map macros;
+    token_vec macro_work;  // scratch stack for macro arguments and substitutions; every expansion truncates it back when done
+    int macro_expansions;
+
+    // pch.c
+    char *pch_dir;
+    int pch_recording;  // number of files being recorded, inner ones included
+    pch_frame_vec pch_frames;
+    int pch_loaded;
+    int pch_written;
+    char *pch_buf;
+    int pch_len;
+    int pch_cap;
+    str_map pch_strings;  // strings of the tokens being written: the value is the index + 1
+    char_p_vec pch_string_list;
+    int *pch_src_index;   // index of each source referred by the tokens being written, or -1
+    int_vec pch_src_list;
+    char *pch_in;
+    int pch_in_len;
+    int pch_in_pos;
+    int pch_in_files_pos;  // of the file list, read again to note the files while recording
+    bool pch_in_broken;
+    char **pch_in_strings;
+    char **pch_in_idents;  // interned on first use
+    int *pch_in_src_ids;
+    void *pch_keeper;     // context keeping the loaded caches for later compiles, or NULL
+    str_map pch_kept;     // of a keeper: cache file name -> pch_kept_t
+    vec pch_retired;      // of a keeper: kept caches replaced by newer ones, unmapped by pch_trim()
+
+    // type.c
+    type_vec types;
+    str_map type_names;
+    type_t *type_int;
+    type_t *type_void;
+    type_t *type_char;
+    type_t *type_long;
+    type_t *type_void_ptr;
+    type_t *type_char_ptr;
+    struct_vec structs;
+    str_map struct_names;
+    str_map union_names;
+    enum_vec enums;
+    str_map enum_names;
+
+    // var.c
+    frame_vec env;
+    int max_offset;
+    str_map bindings;            // scoped symbol table: name -> the innermost visible binding
+    binding_t *free_bindings;    // bindings released by unbind_frame(), linked through 'shadowed' for reuse
+    vec block_vars;              // var_vec of the block frames by depth, reused by the next frame at the depth
+    int vars_added;
+
+    // func.c
+    func_vec functions;
+    str_map function_names;  // index of functions by name. functions keeps the declaration order
+
+    // gstr.c
+    char_p_vec gstrings;
+    str_map gstring_index;  // string -> (index in gstrings) + 1
+    int_vec_vec global_array;
+
+    // atom.c: atoms live in fixed-size chunks so that a node and its following ARG atoms
+    // (p+1, p+2, ...) stay contiguous and pointers into the pool stay valid while it grows
+    atom_t **atom_chunks;
+    int atom_chunks_len;
+    int atom_chunks_cap;
+    int atom_pos;
+    int atom_peak;
+    int NOP_ATOM;
+
+    // emit.c
+    bool streaming;       // functions are emitted as soon as parsed, between stream_open() and stream_close()
+    int emitted_lines;
+    int label_index;
+    int stack_offset;
+    int *reg_in_use;
+    int func_return_label;
+    int func_void_return_label;
+    break_label_vec break_labels;
+    char *escape_buf;     // scratch for the escaped string literals, reused by each one
+    int escape_cap;
+
+    // outbuf.c
+    int outbuf_fd;
+    char *outbuf_body;
+    int outbuf_len;
+    int outbuf_cap;
+    int outbuf_writes;
+} context_t;
+
+#ifdef __GNUC__
+extern __thread context_t *ctx;
+#else
+extern context_t *ctx;
+#endif
+
+context_t *context_new();
+context_t *context_use(context_t *c);
+void context_free(context_t *c);
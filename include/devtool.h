@@ -1,4 +1,23 @@
+typedef enum {
+    LOG_NONE,
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+} log_level_e;
+
+/*
+ * messages above log_level are dropped before formatting.
+ * callers building expensive arguments (dump_type, dump_atom, ...) should test
+ * 'log_level >= LOG_DEBUG' themselves so that the arguments are not built at all.
+ */
+extern int log_level;
+
+void set_log_level(int level);
+void init_log_level(char *level_name);
+
 void debug(char *, ...);
+void info(char *, ...);
 void warning(char *, ...);
 void error(char *, ...);
 char * _slice(char *, int);
@@ -0,0 +1,21 @@
+/*
+ * emit.h
+ *
+ * x64 assembly generation from the parsed atoms.
+ *
+ * - compile_file(fd) : emits the whole parsed file
+ * - stream_open(fd), stream_close() : emit a file while it is parsed. in between, parse() hands
+ *   each function definition to stream_function() as soon as it ends, which releases its atoms,
+ *   and the global vars and strings are emitted at the close
+ */
+typedef struct {
+    int break_label;
+    int continue_label;
+} break_label_t;
+
+VEC_HEADER(break_label_t, break_label_vec)
+
+void compile_file(int fd);
+void stream_open(int fd);
+void stream_function(func *f, int mark);
+void stream_close();
@@ -1,5 +1,6 @@
 typedef struct {
     char *filename;
+    char *path;  // resolved path of a source file, NULL for text made by the compiler
     int id;
     char *body;
     int pos;
@@ -12,15 +13,30 @@ typedef struct {
     int prev_pos;
 } src_t;
 
-extern src_t *src;
+VEC_INLINE_HEADER(src_t, src_vec)
+
+void add_memory_file(char *path, char *body, int len);
+bool is_memory_file(char *path);
+char *find_file(char *filename);
+void set_include_guard(char *path, char *guard);
+char *get_include_guard(char *path);
+
+char *map_file(int fd, int *len);
+void unmap_file(char *body);
+int add_src(char *filename, char *path, char *body, int len);
+bool file_stat(char *path, long *size, long *mtime);
+long hash_bytes(char *p, int len);
 
 bool enter_file(char *filename);
+bool enter_file_path(char *filename, char *path);
 bool enter_new_file(char *filename, char *body, int pos, int len, int line, int column);
 bool exit_file();
 char *dump_file(int id, int start_pos, int end_pos);
 char *file_get_part(int id, int start_pos, int end_pos);
 src_t *file_info(int id);
+int src_count();
 
 int ch();
+int ch_next();
 bool next();
 bool is_eof();
@@ -11,8 +11,7 @@ typedef struct {
 
 VEC_HEADER(func, func_vec)
 
-extern func_vec functions;
-
+// name must be interned (see intern.h)
 func *find_func_name(char *name);
 extern func *add_function(char *, type_t *, bool, bool, int, var_vec);
 extern func *func_set_body(func *, int, var_vec, int, int);
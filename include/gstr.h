@@ -1,3 +1,5 @@
+VEC_HEADER(int_vec, int_vec_vec)
+
 extern char *find_global_string(int);
 extern int add_global_string(char *);
 
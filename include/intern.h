@@ -0,0 +1,6 @@
+/*
+ * intern(str) returns the unique copy of str; equal strings get the same pointer,
+ * so interned names can be compared with '=='. the returned string must not be modified.
+ */
+extern char *intern(const char *str);
+extern int intern_count();
@@ -0,0 +1,30 @@
+/*
+ * librcc.h
+ *
+ * The compiler as a library (bin/librcc.a by 'make lib'): compiles a C source in memory into
+ * x64 asm in memory, with no temporary files or processes. Every call runs in a context of its
+ * own (see context.h), so nothing is left over between calls, and threads may compile at once.
+ *
+ * - rcc_compile(src, len, options, &out, &out_len) : returns 0 and the asm in out, or 1 and the
+ *   error message in out. out is malloc'ed and null-terminated; the caller frees it
+ *
+ * Includes are looked up by the resolver first, then in include_dirs and the dir of filename.
+ * Every compile includes rcc/args.h, so one of them must give it (it is in include/ of rcc).
+ * The resolver returns the text of the named file and its length, or NULL to fall back to the
+ * dirs; the text must stay valid until rcc_compile() returns. It is called in gcc builds only,
+ * as rcc does not call through function pointers.
+ */
+#ifdef __GNUC__
+typedef char *(*rcc_include_resolver_t)(void *data, const char *name, long *len);
+#else
+typedef void *rcc_include_resolver_t;
+#endif
+
+typedef struct {
+    char *filename;       // name of the source in messages, "input.c" if NULL
+    char **include_dirs;  // NULL-terminated, or NULL
+    rcc_include_resolver_t include_resolver;  // or NULL
+    void *include_resolver_data;              // passed to the resolver as it is
+} rcc_options_t;
+
+int rcc_compile(const char *src, long len, rcc_options_t *options, char **out, long *out_len);
@@ -1,15 +1,27 @@
+/*
+ * macro.h
+ *
+ * Macros are kept as token lists: the body is lexed once at #define, with
+ * parameters replaced by T_MACRO_PARAM and '##' by T_PASTE.
+ * An expansion splices those tokens (and the argument tokens) into the output
+ * token_vec directly; no text is rebuilt and re-lexed except for '##' results.
+ * include token.h before this header.
+ */
+#define MACRO_MAX_ARGS 32
+
 typedef struct {
     char *name;
-    src_t *src;
-    int start_pos;
-    int end_pos;
-    char_p_vec vars;
+    int nparams;
+    token *body;
+    int body_len;
+    bool is_function;
+    bool expanding;
+    long hash;  // of the definition; tells whether two definitions are the same
 } macro_t;
 
-void add_macro(const char *name, int start_pos, int end_pos, char_p_vec vars);
+void add_macro(const char *name, bool is_function, int nparams, token *body, int body_len);
 void delete_macro(const char *name);
 macro_t *find_macro(const char *name);
 
-bool enter_macro(const char *name);
-bool exit_macro();
-void extract_macro(char *buf);
+bool expand_source_macro(macro_t *m, token_vec out);
+void expand_tokens(token_vec in, int from, int to, token_vec out);
@@ -0,0 +1,33 @@
+/*
+ * map.h
+ *
+ * A string-keyed hash map (open addressing with linear probing).
+ * - str_map_new() : returns a pointer to allocated map
+ * - str_map_get(map, key) : returns the value for the key, or NULL if not found
+ * - str_map_put(map, key, value) : adds or replaces the value for the key
+ * - str_map_delete(map, key) : removes the key. returns FALSE if not found
+ * - str_map_next(map, &iter) : iterates over the live keys; start with iter = 0, returns NULL at the end
+ *
+ * Keys are not copied; the caller must keep them alive while they are in the map.
+ * The map is allocated from the arena (see arena.h), so it needs no free.
+ * Values must not be NULL.
+ */
+#define STR_MAP_INITIAL_CAP 16
+#define STR_MAP_EMPTY -1
+#define STR_MAP_DELETED -2
+
+typedef struct {
+    char **keys;
+    void **values;
+    int *hashes;  // STR_MAP_EMPTY, STR_MAP_DELETED or the hash of the key
+    int len;      // number of live keys
+    int used;     // number of live or deleted slots
+    int cap;
+} * str_map;
+
+extern str_map str_map_new();
+extern int str_map_hash(const char *key);
+extern void *str_map_get(str_map m, const char *key);
+extern void str_map_put(str_map m, const char *key, void *value);
+extern bool str_map_delete(str_map m, const char *key);
+extern char *str_map_next(str_map m, int *iter);
@@ -0,0 +1,15 @@
+/*
+ * outbuf - buffered writer for the generated assembly.
+ *
+ * Output is accumulated in a chunk of OUTBUF_CHUNK_SIZE bytes and written to the fd only when
+ * the chunk is full or outbuf_flush() is called. A single item larger than the chunk grows it.
+ * Opened with fd -1, the chunk grows instead, to keep the whole output for outbuf_contents().
+ */
+#define OUTBUF_CHUNK_SIZE (64*1024)
+
+extern void outbuf_open(int fd);
+extern void outbuf_flush();
+extern void outbuf_write(char *s, int len);
+extern bool outbuf_vprintf(char *fmt, va_list va);
+extern int outbuf_write_count();
+extern char *outbuf_contents(int *len);
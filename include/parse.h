@@ -1,4 +1,2 @@
 void parse();
 void parse_init();
-
-extern atom_t program[];
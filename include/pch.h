@@ -0,0 +1,94 @@
+/*
+ * pch.h
+ *
+ * Precompiled headers. What tokenizing an included file produces (tokens, macro definitions and
+ * include guards) is recorded and written to a cache file, keyed by the resolved path and the
+ * include dirs. A later include replays the cache instead, if
+ * - the file and the files it included are unchanged (same size and mtime, or same content hash)
+ * - every macro name the file looked up from outside has the same definition as when recorded
+ * - every '#pragma once' file it included or skipped is still not included or included already
+ * The cache keeps the source text the tokens refer to, so it is loaded by a single mmap.
+ * Numbers are written byte by byte, so caches are shared between the gcc and rcc builds.
+ *
+ * - pch_set_dir(dir) : enables the cache in dir
+ * - pch_load(path) : replays the cache of the file. returns FALSE if there is no valid cache
+ * - pch_begin(path, depth) / pch_end(depth) : records tokenizing the file, then writes the cache.
+ *   depth is the #ifdef nesting, which must be the same at both ends
+ * - pch_note_*() : called by macro.c and token.c while pch_recording
+ * - pch_keep(keeper) : keeps the caches loaded from now on mapped in keeper, a context living
+ *   longer than the current one, so that later compiles take them from memory while the cache
+ *   files are unchanged. pch_trim(keeper) unmaps the replaced ones; call it between compiles
+ *
+ * include map.h, token.h and macro.h before this header.
+ */
+#define PCH_MAGIC "rcc-pch-2"
+
+typedef struct {
+    char *path;
+    long size;
+    long mtime;
+    long hash;
+} pch_file_t;
+
+typedef struct {
+    char *name;
+    long hash;  // of the definition, 0 if it was not defined
+} pch_dep_t;
+
+typedef struct {
+    char *name;
+    macro_t *m;  // NULL for #undef
+} pch_op_t;
+
+typedef struct {
+    char *path;
+    char *guard;
+} pch_guard_t;
+
+typedef struct {
+    char *path;       // of a '#pragma once' file
+    bool included;    // if it was included already when the recorded file included it
+} pch_once_t;
+
+VEC_INLINE_HEADER(pch_file_t, pch_file_vec)
+VEC_INLINE_HEADER(pch_dep_t, pch_dep_vec)
+VEC_INLINE_HEADER(pch_op_t, pch_op_vec)
+VEC_INLINE_HEADER(pch_guard_t, pch_guard_vec)
+VEC_INLINE_HEADER(pch_once_t, pch_once_vec)
+
+typedef struct {
+    char *path;
+    int token_start;
+    int depth;
+    str_map touched;  // macro names defined, undefined or looked up so far
+    pch_file_vec files;
+    pch_dep_vec deps;
+    pch_once_vec onces;
+    pch_op_vec ops;
+    pch_guard_vec guards;
+} pch_frame_t;
+
+VEC_INLINE_HEADER(pch_frame_t, pch_frame_vec)
+
+typedef struct {
+    char *body;
+    int len;
+    long size;   // of the cache file when mapped
+    long mtime;
+} pch_kept_t;
+
+void pch_set_dir(char *dir);
+bool pch_load(char *path);
+void pch_begin(char *path, int depth);
+void pch_end(int depth);
+
+void pch_note_lookup(const char *name, macro_t *m);
+void pch_note_define(macro_t *m);
+void pch_note_undef(const char *name);
+void pch_note_file(char *path, long size, long mtime, long hash);
+void pch_note_guard(char *path, char *guard);
+void pch_note_once(char *path, bool included);
+
+void pch_stats(int *loaded, int *written);
+void pch_keep(void *keeper);
+void pch_trim(void *keeper);
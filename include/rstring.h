@@ -1,5 +1,6 @@
 extern long strlen(const char *);
 extern char *strdup(const char *);
+extern char *strcpy(char *, const char *);
 extern char *strcat(char *, const char *);
 extern int strcmp(char *, const char *);
 extern int strncmp(const char *, const char *, long);
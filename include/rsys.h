@@ -1,12 +1,45 @@
 extern void exit(int);
+extern char *getenv(const char *);
 
-extern int open(char *, int);
+extern int open(char *, int, ...);
 extern int close(int);
+extern int access(char *, int);
+extern int stat(char *, long *);
+extern int rename(char *, char *);
+extern int mkdir(char *, int);
+extern int getpid();
+extern int fork();
+extern int wait(int *);
+extern int unlink(char *);
+extern int dup(int);
+extern int dup2(int, int);
+extern int chdir(char *);
+extern char *getcwd(char *, long);
+extern int socket(int, int, int);
+extern int bind(int, char *, int);
+extern int listen(int, int);
+extern int accept(int, char *, int *);
+extern int connect(int, char *, int);
+extern long sendmsg(int, long *, int);
+extern long recvmsg(int, long *, int);
+extern void *signal(int, void *);
 extern int read(int, char *, int);
 extern int write(int, char *, int);
+extern long lseek(int, long, int);
+extern void *mmap(void *, long, int, int, int, long);
+extern int munmap(void *, long);
 
 extern void *calloc(long, long);
 extern void *realloc(void *, long);
 extern void *malloc(long);
+extern void free(void *);
+extern void *memset(void *, int, long);
+extern void *memcpy(void *, void *, long);
 
 extern int isatty(int);
+extern int clock_gettime(int, long *);
+extern int getrusage(int, long *);
+#define JMP_BUF_LONGS 25  // sizeof(jmp_buf) of glibc on x86_64, in longs
+extern int _setjmp(long *);
+extern void longjmp(long *, int);
+extern int atoi(char *);
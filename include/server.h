@@ -0,0 +1,26 @@
+/*
+ * server.h
+ *
+ * The transport of 'rcc --server' and 'rcc --client' over a unix socket. A request carries the
+ * working dir, RCC_LOG_LEVEL and the command line args of the client, with its stdout and stderr
+ * attached; the server compiles on them directly and replies the exit status in one byte.
+ *
+ * - server_listen(path) : binds the socket, replacing a stale one
+ * - server_accept(s, &level, &argc, &argv) : waits for a request, enters its working dir and
+ *   redirects stdout and stderr to the client's. the request is allocated in the current context.
+ *   returns FALSE for a broken request, which is dropped
+ * - server_reply(s, status) : restores stdout and stderr, and ends the request
+ * - client_request(path, argc, argv, &status) : sends the request and waits for the status.
+ *   returns FALSE if there is no server at path
+ */
+typedef struct {
+    int sock;
+    int conn;        // of the current request
+    int saved_out;   // stdout and stderr of the server itself
+    int saved_err;
+} server_t;
+
+server_t *server_listen(char *path);
+bool server_accept(server_t *s, char **level, int *argc, char ***argv);
+void server_reply(server_t *s, int status);
+bool client_request(char *path, int argc, char **argv, int *status);
@@ -0,0 +1,23 @@
+/*
+ * stats.h
+ *
+ * 'rcc --stats' : the wall time of each compile phase and the size of what the phases made,
+ * reported on stderr as text or JSON when the source is compiled. The counters behind it are
+ * plain increments kept anyway, and the clock is read only while ctx->stats is set.
+ *
+ * - stats_clock() : the monotonic clock in microseconds
+ * - stats_start() : returns the start of a phase, or 0 if stats are off
+ * - stats_phase(name, start) : records the phase from start until now
+ * - stats_report(filename) : writes the phases and the counters to stderr
+ * - append_json_string(buf, size, s) : appends s to buf as a quoted JSON string, cut short to fit
+ *   in the size of buf
+ */
+#define STATS_NONE 0
+#define STATS_TEXT 1
+#define STATS_JSON 2
+
+long stats_clock();
+long stats_start();
+void stats_phase(char *name, long start);
+void stats_report(char *filename);
+void append_json_string(char *buf, int size, char *s);
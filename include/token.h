@@ -27,7 +27,8 @@ typedef enum {
     T_PIPE, T_HAT,
     T_SWITCH, T_CASE, T_COLON, T_DEFAULT,
     T_QUESTION,
-    T_EXTERN, T_CONST, T_3DOT
+    T_EXTERN, T_CONST, T_3DOT,
+    T_MACRO_PARAM, T_PASTE  // only in macro bodies: a parameter (int_value is its index) and '##'
 } token_id;
 
 typedef struct {
@@ -45,6 +46,9 @@ typedef struct {
     int src_end_pos;
 } token;
 
+VEC_INLINE_HEADER(token, token_vec)
+VEC_HEADER(bool, bool_vec)
+
 extern bool expect(token_id id);
 extern bool expect_int(int *value);
 extern bool expect_long(long *value);
@@ -53,6 +57,8 @@ extern bool expect_ident(char **value);
 extern bool expect_string(char **value);
 
 extern void tokenize_file(char *);
+extern void lex_text(char *text, token_vec out);
+extern bool lex_macro_args(token_vec out);
 extern int get_token_pos();
 extern void set_token_pos(int pos);
 extern bool is_eot();
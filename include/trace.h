@@ -0,0 +1,23 @@
+/*
+ * trace.h
+ *
+ * 'rcc --trace=<file>' : the time spent in each compile phase, include, macro expansion and
+ * emitted function, written as Chrome trace events (a JSON array of "B" / "E" events in
+ * microseconds) to be opened in a trace viewer such as chrome://tracing or Perfetto.
+ * The processes of 'rcc -j' append to the same file, each as a process of its own.
+ *
+ * - trace_open(path) : creates the file and starts the array. returns the fd for trace_close()
+ * - trace_source(filename) : starts the events of a source in this process
+ * - trace_begin(category, name), trace_end() : an event around a span; they must nest.
+ *   nothing is done unless the trace is open
+ * - trace_flush() : writes out the events buffered in the current context
+ * - trace_close(fd) : ends the array after every process has flushed
+ */
+#define TRACE_BUF_SIZE (64*1024)
+
+int trace_open(char *path);
+void trace_source(char *filename);
+void trace_begin(char *category, char *name);
+void trace_end();
+void trace_flush();
+void trace_close(int fd);
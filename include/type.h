@@ -6,7 +6,7 @@ typedef struct member_t {
     struct type_t *t;
 } member_t;
 
-VEC_HEADER(member_t, member_vec)
+VEC_INLINE_HEADER(member_t, member_vec)
 
 typedef struct struct_t {
     char *name;
@@ -34,17 +34,23 @@ typedef struct type_t {
     struct_t *struct_of;
     enum_t *enum_of;
     type_t *typedef_of;
+
+    /*
+     * derived types are hash-consed on the unaliased base type,
+     * so that the same pointer/array type is always the same type_t
+     */
+    type_t *pointer_type;  // the pointer type to this type
+    type_t *array_types;   // list of array types of this type, linked by next_array
+    type_t *next_array;
 } type_t;
 
-extern type_t *type_int;
-extern type_t *type_void;
-extern type_t *type_char;
-extern type_t *type_long;
-extern type_t *type_void_ptr;
-extern type_t *type_char_ptr;
+VEC_HEADER(type_t, type_vec)
+VEC_HEADER(struct_t, struct_vec)
+VEC_HEADER(enum_t, enum_vec)
 
 extern void init_types();
 extern type_t *add_type(char *, int , type_t *, int );
+// names given to find_* must be interned (see intern.h)
 extern type_t *find_type(char *);
 extern char *dump_type(type_t *);
 
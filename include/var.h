@@ -13,7 +13,7 @@ typedef struct {
     };
 } var_t;
 
-VEC_HEADER(var_t, var_vec)
+VEC_INLINE_HEADER(var_t, var_vec)
 
 typedef struct {
     var_vec vars;
@@ -23,6 +23,19 @@ typedef struct {
     int num_stack_vars;
 } frame_t;
 
+VEC_HEADER(frame_t, frame_vec)
+
+/*
+ * scoped symbol table entry for a name: the innermost visible binding.
+ * each binding remembers the outer one it shadows, which is restored on exit_var_frame().
+ * a binding holds indexes, not a var_t pointer, because var_vec storage moves as it grows.
+ */
+typedef struct binding_t {
+    int frame_pos;
+    int var_index;
+    struct binding_t *shadowed;
+} binding_t;
+
 extern void enter_var_frame();
 extern void enter_function_args_var_frame();
 extern void exit_var_frame();
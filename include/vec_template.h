@@ -18,6 +18,11 @@
  * - Generates the body of operating functions. Usually written in .c files.
  * 
  * Note: <vector_type_name> might be better to named as <target_type>_vec, or <pointed_type>_p_vec if <target_type> is a pointer.
+ *
+ * Each item is allocated separately from the arena (see arena.h, which must be included before
+ * VEC_BODY), so a pointer to an item stays valid while the vector grows. Popped items are not reused.
+ * The item array is in the arena as well, so a vector needs no free.
+ * See VEC_INLINE_HEADER below for the contiguous variant.
  */
 #define VEC_MODERATE_EXTEND 1024*1024
 
@@ -46,19 +51,20 @@ extern item_t *VEC_CONCAT(container_t, _set)(container_t p, int index, item_t v)
 item_t *VEC_CONCAT(container_t, _extend)(container_t p, int size) {\
     p->len += size;\
     if (p->len >= p->cap) {\
+        int old_cap = p->cap;\
         p->cap += (p->cap < VEC_MODERATE_EXTEND) ? p->cap : (p->cap >> 2);\
-        p->items = realloc(p->items, p->cap * sizeof(item_t *));\
+        p->items = arena_realloc(p->items, old_cap * sizeof(item_t *), p->cap * sizeof(item_t *));\
     }\
-    item_t *item = calloc(sizeof(item_t),1); \
+    item_t *item = arena_alloc(sizeof(item_t)); \
     p->items[p->len-1] = item; \
     return item; \
 }\
 \
 container_t VEC_CONCAT(container_t, _new)() {\
-    container_t p = malloc(sizeof(container_t));\
+    container_t p = arena_alloc(sizeof(*p));\
     p->cap = 8;\
     p->len = 0;\
-    p->items = calloc(sizeof(item_t *), p->cap);\
+    p->items = arena_alloc(p->cap * sizeof(item_t *));\
     return p;\
 }\
 \
@@ -98,3 +104,99 @@ item_t *VEC_CONCAT(container_t, _set)(container_t p, int index, item_t v) {\
     }\
 }\
 
+
+/*
+ * VEC_INLINE_HEADER(<target_type>, <vector_type_name>)
+ * VEC_INLINE_BODY(<target_type>, <vector_type_name>)
+ *
+ * Same operations as above, but the items are stored inline in one contiguous array (vec->items[index]
+ * is an item, not a pointer) which grows by arena_realloc(). Use this for large or hot vectors.
+ * - <vector_type>_reserve(vec, size) : like _extend() but leaves the new items uncleared
+ *
+ * Pointer stability: a pointer returned by _extend(), _push(), _pop(), _top(), _get() or _set() is
+ * invalidated by the next _extend() or _push() on the same vector. Keep an index instead of a pointer
+ * when the vector may grow while the item is in use.
+ */
+#define VEC_INLINE_HEADER(item_t, container_t) \
+typedef struct { \
+    item_t *items; \
+    int len; \
+    int cap; \
+} * container_t; \
+\
+extern container_t VEC_CONCAT(container_t,_new)(); \
+extern item_t *VEC_CONCAT(container_t, _reserve)(container_t p, int size);\
+extern item_t *VEC_CONCAT(container_t, _extend)(container_t p, int size);\
+extern item_t *VEC_CONCAT(container_t,_push)(container_t p, item_t v);\
+extern item_t *VEC_CONCAT(container_t, _pop)(container_t p);\
+extern item_t *VEC_CONCAT(container_t, _top)(container_t p);\
+extern int VEC_CONCAT(container_t, _len)(container_t p);\
+extern item_t *VEC_CONCAT(container_t, _get)(container_t p, int index);\
+extern item_t *VEC_CONCAT(container_t, _set)(container_t p, int index, item_t v);\
+
+
+#define VEC_INLINE_BODY(item_t, container_t) \
+\
+item_t *VEC_CONCAT(container_t, _reserve)(container_t p, int size) {\
+    if (p->len + size > p->cap) {\
+        int old_cap = p->cap;\
+        while (p->len + size > p->cap) {\
+            p->cap += (p->cap < VEC_MODERATE_EXTEND) ? p->cap : (p->cap >> 2);\
+        }\
+        p->items = arena_realloc(p->items, old_cap * sizeof(item_t), p->cap * sizeof(item_t));\
+    }\
+    item_t *item = &p->items[p->len]; \
+    p->len += size;\
+    return item; \
+}\
+\
+item_t *VEC_CONCAT(container_t, _extend)(container_t p, int size) {\
+    item_t *item = VEC_CONCAT(container_t, _reserve)(p, size);\
+    memset(item, 0, size * sizeof(item_t));\
+    return item; \
+}\
+\
+container_t VEC_CONCAT(container_t, _new)() {\
+    container_t p = arena_alloc(sizeof(*p));\
+    p->cap = 8;\
+    p->len = 0;\
+    p->items = arena_alloc(p->cap * sizeof(item_t));\
+    return p;\
+}\
+\
+item_t *VEC_CONCAT(container_t,_push)(container_t p, item_t v) {\
+    item_t *item = VEC_CONCAT(container_t, _reserve)(p,1);\
+    *item = v; \
+    return item;\
+}\
+\
+item_t *VEC_CONCAT(container_t, _pop)(container_t p) {\
+    if (p->len > 0) { \
+        p->len--; \
+        return &p->items[p->len]; \
+    } else {\
+        return (item_t *)0;\
+    }\
+}\
+\
+item_t *VEC_CONCAT(container_t, _top)(container_t p) {\
+    return p->len > 0 ? &p->items[p->len - 1] : (item_t *)0;\
+}\
+\
+int VEC_CONCAT(container_t, _len)(container_t p) {\
+    return p->len;\
+}\
+\
+item_t *VEC_CONCAT(container_t, _get)(container_t p, int index) {\
+    return (0 <= index && index < p->len) ? &p->items[index] : (item_t *)0;\
+}\
+\
+item_t *VEC_CONCAT(container_t, _set)(container_t p, int index, item_t v) {\
+    if (0 <= index && index < p->len) {\
+        p->items[index] = v;\
+        return &p->items[index];\
+    } else {\
+        return (item_t *)0;\
+    }\
+}\
+
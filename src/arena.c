@@ -0,0 +1,117 @@
+#include "types.h"
+#include "rsys.h"
+#include "rstring.h"
+#include "vec.h"
+#include "map.h"
+
+#include "arena.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
+char *arena_new_chunk(long size) {
+    char *chunk = calloc(size + 8, 1);
+    if (!chunk) {
+        write(2, "arena: out of memory\n", 21);
+        exit(1);
+    }
+    *(char **)chunk = ctx->arena_chunks;
+    ctx->arena_chunks = chunk;
+    ctx->arena_chunks_len++;
+    ctx->arena_heap_calls++;
+    return chunk + 8;
+}
+
+void *arena_alloc(long size) {
+    size = (size + 7) / 8 * 8;
+    ctx->arena_total += size;
+    if (size > ARENA_CHUNK_SIZE / 4) {
+        return arena_new_chunk(size);
+    }
+    if (!ctx->arena_top || ctx->arena_pos + size > ARENA_CHUNK_SIZE) {
+        ctx->arena_top = arena_new_chunk(ARENA_CHUNK_SIZE);
+        ctx->arena_pos = 0;
+    }
+    char *p = ctx->arena_top + ctx->arena_pos;
+    ctx->arena_pos += size;
+    return p;
+}
+
+/*
+ * a block larger than a quarter chunk is a chunk of its own, so it is reallocated in the heap
+ * and relinked in place of the old one
+ */
+char *arena_realloc_chunk(char *p, long old_size, long size) {
+    char *chunk = p - 8;
+    char *grown = realloc(chunk, size + 8);
+    if (!grown) {
+        write(2, "arena: out of memory\n", 21);
+        exit(1);
+    }
+    ctx->arena_heap_calls++;
+    if (ctx->arena_chunks == chunk) {
+        ctx->arena_chunks = grown;
+    } else {
+        char *c = ctx->arena_chunks;
+        while (*(char **)c != chunk) {
+            c = *(char **)c;
+        }
+        *(char **)c = grown;
+    }
+    ctx->arena_total += size - old_size;
+    return grown + 8;
+}
+
+void *arena_realloc(void *p, long old_size, long new_size) {
+    old_size = (old_size + 7) / 8 * 8;
+    long size = (new_size + 7) / 8 * 8;
+    if (p && old_size > ARENA_CHUNK_SIZE / 4) {
+        return arena_realloc_chunk(p, old_size, size);
+    }
+    if (p && size <= ARENA_CHUNK_SIZE / 4 && (char *)p + old_size == ctx->arena_top + ctx->arena_pos && ctx->arena_pos - old_size + size <= ARENA_CHUNK_SIZE) {
+        ctx->arena_pos += size - old_size;
+        ctx->arena_total += size - old_size;
+        return p;
+    }
+    char *q = arena_alloc(size);
+    if (p) {
+        memcpy(q, p, old_size);
+    }
+    return q;
+}
+
+char *arena_strdup(const char *str) {
+    char *s = arena_alloc(strlen(str) + 1);
+    strcpy(s, str);
+    return s;
+}
+
+void arena_release() {
+    while (ctx->arena_chunks) {
+        char *next = *(char **)ctx->arena_chunks;
+        free(ctx->arena_chunks);
+        ctx->arena_chunks = next;
+    }
+    ctx->arena_top = NULL;
+    ctx->arena_pos = 0;
+    ctx->arena_total = 0;
+    ctx->arena_chunks_len = 0;
+    ctx->arena_heap_calls = 0;
+}
+
+long arena_allocated() {
+    return ctx->arena_total;
+}
+
+int arena_chunk_count() {
+    return ctx->arena_chunks_len;
+}
@@ -1,19 +1,23 @@
 #include "types.h"
 #include "rsys.h"
+#include "arena.h"
 #include "rstring.h"
 #include "devtool.h"
 #include "vec.h"
+#include "map.h"
 
+#include "token.h"
+#include "file.h"
 #include "type.h"
 #include "var.h"
 #include "func.h"
 #include "atom.h"
-#include "token.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
 
-#define NUM_ATOMS 100000
-
-atom_t program[NUM_ATOMS];
-int atom_pos = 1;
 
 char *atom_name[] = {
     "args", "int", "add", "sub", "mul", "div", "mod", "bit-and","bit-or","bit-xor", "bit-neg", "bit-lshift", "bit-rshift",
@@ -51,17 +55,67 @@ bool is_arithmetic_operator(int type) {
     return is_order_operator(type);
 }
 
+atom_t *atom_at(int pos) {
+    atom_t *chunk = ctx->atom_chunks[pos >> ATOM_CHUNK_BITS];
+    return &chunk[pos & (ATOM_CHUNK_SIZE - 1)];
+}
+
+void atom_add_chunk() {
+    if (ctx->atom_chunks_len == ctx->atom_chunks_cap) {
+        int old_cap = ctx->atom_chunks_cap;
+        ctx->atom_chunks_cap = old_cap ? old_cap * 2 : 16;
+        ctx->atom_chunks = arena_realloc(ctx->atom_chunks, old_cap * sizeof(atom_t *), ctx->atom_chunks_cap * sizeof(atom_t *));
+    }
+    ctx->atom_chunks[ctx->atom_chunks_len++] = arena_alloc(ATOM_CHUNK_SIZE * sizeof(atom_t));
+}
+
+/*
+ * allocates 'size' contiguous atoms; a node never straddles two chunks
+ */
 int alloc_atom(int size) {
-    int current;
-    current = atom_pos;
-    if (atom_pos + size >= NUM_ATOMS) {
-        error("Source code too long");
+    if (size > ATOM_CHUNK_SIZE) {
+        error("too many atoms in a node: %d", size);
+    }
+    if ((ctx->atom_pos & (ATOM_CHUNK_SIZE - 1)) + size > ATOM_CHUNK_SIZE) {
+        ctx->atom_pos = (ctx->atom_pos | (ATOM_CHUNK_SIZE - 1)) + 1; // skip to the next chunk
+    }
+    while (((ctx->atom_pos + size - 1) >> ATOM_CHUNK_BITS) >= ctx->atom_chunks_len) {
+        atom_add_chunk();
+    }
+    int current = ctx->atom_pos;
+    if (current < ctx->atom_peak) {
+        memset(atom_at(current), 0, size * sizeof(atom_t)); // released by atom_release(), maybe dirty
+    }
+    atom_at(current)->token_pos = get_token_pos();
+    ctx->atom_pos += size;
+    if (ctx->atom_pos > ctx->atom_peak) {
+        ctx->atom_peak = ctx->atom_pos;
     }
-    program[atom_pos].token_pos = get_token_pos();
-    atom_pos += size;
     return current;
 }
 
+int atom_mark() {
+    return ctx->atom_pos;
+}
+
+/*
+ * releases the atoms allocated since atom_mark() returned mark, to be reused by the next alloc_atom()
+ */
+void atom_release(int mark) {
+    ctx->atom_pos = mark;
+    if (ctx->NOP_ATOM >= mark) {
+        ctx->NOP_ATOM = 0;
+    }
+}
+
+int atom_count() {
+    return ctx->atom_peak - 1;
+}
+
+int atom_chunk_count() {
+    return ctx->atom_chunks_len;
+}
+
 void dump_atom3(char *buf, atom_t *p, int indent, int pos) {
     for (int i=0; i<indent; i++) {
         strcat(buf, " ");
@@ -85,7 +139,7 @@ void dump_atom3(char *buf, atom_t *p, int indent, int pos) {
 }
 
 void dump_atom(int pos, int indent) {
-    dump_atom2(&program[pos], indent, pos);
+    dump_atom2(atom_at(pos), indent, pos);
 }
 void dump_atom2(atom_t *p, int indent, int pos) {
     char buf[RCC_BUF_SIZE] = {0};
@@ -95,14 +149,14 @@ void dump_atom2(atom_t *p, int indent, int pos) {
 
 void dump_atom_all() {
     int i;
-    for (i=1; i<atom_pos; i++) {
+    for (i=1; i<ctx->atom_pos; i++) {
         dump_atom(i, 0);
     }
 }
 
 void dump_atom_tree(int pos, int indent) {
     dump_atom(pos, indent);
-    atom_t *a = &program[pos];
+    atom_t *a = atom_at(pos);
     switch (a->type) {
         case TYPE_ANDTHEN:
             dump_atom_tree(a->atom_pos, indent);
@@ -157,9 +211,9 @@ void dump_atom_tree(int pos, int indent) {
             dump_atom_tree((a+2)->atom_pos, indent + 1);
             break;
         case TYPE_APPLY:
-            dump_atom2(++a, indent + 1, pos);
-            for (a++; a->type == TYPE_ARG; a++) {
-                dump_atom_tree(a->atom_pos, indent + 1);
+            dump_atom2(a+1, indent + 1, pos+1);
+            for (int i=0; i<(a+1)->int_value; i++) {
+                dump_atom_tree((a+2+i)->atom_pos, indent + 1);
             }
             break;
         case TYPE_SWITCH:
@@ -172,41 +226,41 @@ void dump_atom_tree(int pos, int indent) {
 }
 
 int atom_set_type(int pos, type_t *t) {
-    program[pos].t = t;
+    atom_at(pos)->t = t;
     return pos;
 }
 
 type_t *atom_type(int pos) {
-    if (program[pos].t == 0) {
+    if (atom_at(pos)->t == 0) {
         error("Null type at atom_t #%d", pos);
     }
-    return program[pos].t;
+    return atom_at(pos)->t;
 }
 
 void build_int_atom(int pos, int type, int value) {
-    atom_t *a = &program[pos];
+    atom_t *a = atom_at(pos);
     a->type = type;
     a->int_value = value;
-    a->t = type_int;
+    a->t = ctx->type_int;
 }
 
 void build_ptr_atom(int pos, int type, void *ptr) {
-    atom_t *a = &program[pos];
+    atom_t *a = atom_at(pos);
     a->type = type;
     a->ptr_value = ptr;
-    a->t = program[pos].t;
+    a->t = atom_at(pos)->t;
 }
 
 void build_pos_atom(int pos, int type, int target) {
-    atom_t *a = &program[pos];
+    atom_t *a = atom_at(pos);
     a->type = type;
     a->atom_pos = target;
-    a->t = program[target].t;
+    a->t = atom_at(target)->t;
 }
 
 int alloc_typed_pos_atom(int type, int pos, type_t *t) {
     int new = alloc_atom(1);
-    atom_t *a = &program[new];
+    atom_t *a = atom_at(new);
     a->type = type;
     a->atom_pos = pos;
     a->t = t;
@@ -215,7 +269,7 @@ int alloc_typed_pos_atom(int type, int pos, type_t *t) {
 
 int alloc_typed_int_atom(int type, int value, type_t *t) {
     int pos = alloc_atom(1);
-    atom_t *a = &program[pos];
+    atom_t *a = atom_at(pos);
     a->type = type;
     a->int_value = value;
     a->t = t;
@@ -224,7 +278,7 @@ int alloc_typed_int_atom(int type, int value, type_t *t) {
 
 int alloc_typed_long_atom(int type, long value, type_t *t) {
     int pos = alloc_atom(1);
-    atom_t *a = &program[pos];
+    atom_t *a = atom_at(pos);
     a->type = type;
     a->long_value = value;
     a->t = t;
@@ -232,7 +286,7 @@ int alloc_typed_long_atom(int type, long value, type_t *t) {
 }
 
 int atom_to_rvalue(int target) {
-    atom_t *a = &program[target];
+    atom_t *a = atom_at(target);
     type_t *t;
     switch (a->type) {
         case TYPE_VAR_REF:
@@ -271,12 +325,12 @@ int alloc_var_atom(var_t *v) {
 
 int alloc_deref_atom(int target) {
     target = atom_to_rvalue(target);
-    atom_t *a = &program[target];
+    atom_t *a = atom_at(target);
     return  alloc_typed_pos_atom(TYPE_PTR_DEREF, target, a->t);
 }
 
 int alloc_ptr_atom(int target) {
-    atom_t *a = &program[target];
+    atom_t *a = atom_at(target);
     switch (a->type) {
         case TYPE_RVALUE:
             error("compiler bug - rvalue shouldn't be here");
@@ -316,7 +370,9 @@ int alloc_index_atom(int base_pos, int index_pos) {
     type_t *t = atom_type(pos);
     int size = 0;
     if (t->array_length >= 0) { // base is an array
-        debug("alloc array index for array: %s", dump_type(t));
+        if (log_level >= LOG_DEBUG) {
+            debug("alloc array index for array: %s", dump_type(t));
+        }
         t = t->ptr_to;
         size = type_size(t);
         if (!t->ptr_to || t->array_length < 0) {
@@ -333,9 +389,11 @@ int alloc_index_atom(int base_pos, int index_pos) {
         error("index for non-array atom #%d", pos);
     }
     index_pos = atom_to_rvalue(index_pos);
-    int pos2 = alloc_typed_pos_atom(TYPE_ARRAY_INDEX, pos, t);
-    alloc_typed_pos_atom(TYPE_ARG, index_pos, atom_type(index_pos));
-    alloc_typed_int_atom(TYPE_ARG, size, type_int);
+    int pos2 = alloc_atom(3);
+    build_pos_atom(pos2, TYPE_ARRAY_INDEX, pos);
+    atom_set_type(pos2, t);
+    build_pos_atom(pos2+1, TYPE_ARG, index_pos);
+    build_int_atom(pos2+2, TYPE_ARG, size);
     //dump_atom_tree(pos2, 0);
     return pos2;
 }
@@ -348,15 +406,15 @@ int alloc_offset_atom(int base_pos, type_t *offset_t, int offset) {
         error("offset for non-struct atom #%d" , pos);
     }
  
-    int pos2 = alloc_binop_atom(TYPE_MEMBER_OFFSET, pos, alloc_typed_int_atom(TYPE_INTEGER, offset, type_int));
+    int pos2 = alloc_binop_atom(TYPE_MEMBER_OFFSET, pos, alloc_typed_int_atom(TYPE_INTEGER, offset, ctx->type_int));
     atom_set_type(pos2, add_pointer_type(offset_t));
     return pos2;
 }
 
 int calculate_if_constant_ops(int type, int lpos, int rpos) {
-    if (program[lpos].type == TYPE_INTEGER && program[rpos].type == TYPE_INTEGER) {
-        int l_int = program[lpos].int_value;
-        int r_int = program[rpos].int_value;
+    if (atom_at(lpos)->type == TYPE_INTEGER && atom_at(rpos)->type == TYPE_INTEGER) {
+        int l_int = atom_at(lpos)->int_value;
+        int r_int = atom_at(rpos)->int_value;
         switch (type) {
             case TYPE_ADD: l_int += r_int; break;
             case TYPE_SUB: l_int -= r_int; break;
@@ -376,7 +434,7 @@ int calculate_if_constant_ops(int type, int lpos, int rpos) {
             case TYPE_EQ_LE: l_int = l_int <= r_int; break;
             case TYPE_EQ_LT: l_int = l_int < r_int; break;
         }
-        return alloc_typed_int_atom(TYPE_INTEGER, l_int, type_int);
+        return alloc_typed_int_atom(TYPE_INTEGER, l_int, ctx->type_int);
     }
     return 0;
 }
@@ -391,7 +449,7 @@ int alloc_binop_atom(int type, int lpos, int rpos) {
         if (rpos_t->ptr_to) {
             error("Cannot + or - between pointers");
         }
-        int size = alloc_typed_int_atom(TYPE_INTEGER, type_size(lpos_t->ptr_to), type_int);
+        int size = alloc_typed_int_atom(TYPE_INTEGER, type_size(lpos_t->ptr_to), ctx->type_int);
         rpos = alloc_binop_atom(TYPE_MUL, rpos, size);
     } else if (!lpos_t->ptr_to && !rpos_t->ptr_to && is_arithmetic_operator(type)) {
         if (lpos_t->size > rpos_t->size) {
@@ -409,13 +467,14 @@ int alloc_binop_atom(int type, int lpos, int rpos) {
 int alloc_assign_op_atom(int type, int lval, int rval) {
     int lval_deref = atom_to_rvalue(lval);
     rval = alloc_binop_atom(type, lval_deref, atom_to_rvalue(rval));
+    rval = atom_convert_type(lval_deref, rval); // the result of 'int += long' is stored as an int
     return alloc_binop_atom(TYPE_BIND, rval, lval);
 }
 
 // make p2's type to p1's type
 int atom_convert_type(int p1, int p2) {
-    type_t *t1 = type_unalias(program[p1].t);
-    type_t *t2 = type_unalias(program[p2].t);
+    type_t *t1 = type_unalias(atom_at(p1)->t);
+    type_t *t2 = type_unalias(atom_at(p2)->t);
 
     if (type_is_same(t1, t2)) {
         return p2;
@@ -430,7 +489,7 @@ int atom_convert_type(int p1, int p2) {
         warning("implicit pointer conversion: %s -> %s", dump_type(t2), dump_type(t1));
         return alloc_typed_pos_atom(TYPE_CONVERT, p2, t1);
     }
-    if ((t1->enum_of && t2 == type_int) || (t1 == type_int && t2->enum_of)) {
+    if ((t1->enum_of && t2 == ctx->type_int) || (t1 == ctx->type_int && t2->enum_of)) {
         return alloc_typed_pos_atom(TYPE_CONVERT, p2, t1);
     }
     dump_atom_tree(p1, 1);
@@ -439,11 +498,9 @@ int atom_convert_type(int p1, int p2) {
     return 0;
 }
 
-int NOP_ATOM = 0;
-
 int alloc_nop_atom() {
-    if (!NOP_ATOM) {
-        NOP_ATOM = alloc_typed_pos_atom(TYPE_NOP, 0, type_void);
+    if (!ctx->NOP_ATOM) {
+        ctx->NOP_ATOM = alloc_typed_pos_atom(TYPE_NOP, 0, ctx->type_void);
     }
-    return NOP_ATOM;
+    return ctx->NOP_ATOM;
 }
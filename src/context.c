@@ -0,0 +1,62 @@
+#include "types.h"
+#include "rsys.h"
+#include "arena.h"
+#include "vec.h"
+#include "map.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
+#ifdef __GNUC__
+__thread context_t *ctx;
+#else
+context_t *ctx;
+#endif
+
+context_t *context_new() {
+    context_t *c = calloc(1, sizeof(context_t));
+    if (!c) {
+        write(2, "context: out of memory\n", 23);
+        exit(1);
+    }
+    c->atom_pos = 1;
+    c->atom_peak = 1;
+    c->outbuf_fd = 1;
+    return c;
+}
+
+context_t *context_use(context_t *c) {
+    context_t *prev = ctx;
+    ctx = c;
+    return prev;
+}
+
+/*
+ * the arena and the mapped files are released while c is current, as they are c's own
+ */
+void context_free(context_t *c) {
+    context_t *prev = context_use(c);
+    if (prev == c) {
+        prev = NULL;
+    }
+    if (c->mapped_bodies) {
+        for (int i=0; i<vec_len(c->mapped_bodies); i++) {
+            void *body = *vec_get(c->mapped_bodies, i);
+            if (body) {
+                munmap(body, *int_vec_get(c->mapped_lens, i));
+            }
+        }
+    }
+    arena_release();
+    context_use(prev);
+    free(c);
+}
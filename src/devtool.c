@@ -2,17 +2,23 @@
 #include "types.h"
 #include "rsys.h"
 #include "rstring.h"
+#include "arena.h"
+#include "vec.h"
+#include "map.h"
+
+#include "devtool.h"
 
 #include "token.h"
 #include "file.h"
-
-typedef enum {
-    WARN,
-    ERROR,
-    DEBUG,
-    INFO,
-    NONE
-} level_e;
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
 
 char *color_red = "\e[31m";
 char *color_green = "\e[32m";
@@ -22,18 +28,42 @@ char *color_magenta = "\e[35m";
 char *color_cyan = "\e[36m";
 char *color_white = "\e[37m";
 
-extern int token_pos;
-extern token *tokens;
+int log_level = LOG_WARN;
+
+void set_log_level(int level) {
+    log_level = level;
+}
+
+/*
+ * accepts a level name (none, error, warn, info, debug) or its number
+ */
+void init_log_level(char *level_name) {
+    if (level_name == NULL || *level_name == 0) {
+        return;
+    }
+    char *names[] = {"none", "error", "warn", "info", "debug"};
+    for (int i=LOG_NONE; i<=LOG_DEBUG; i++) {
+        if (!strcmp(level_name, names[i])) {
+            set_log_level(i);
+            return;
+        }
+    }
+    if (is_digit(*level_name) && level_name[1] == 0) {
+        set_log_level(min(*level_name - '0', LOG_DEBUG));
+        return;
+    }
+    warning("unknown log level: %s", level_name);
+}
 
-void _log(level_e level, char *message) {
-    char *color_str[] = {color_red, color_red, "", color_yellow, ""};
-    char *level_str[] = {"WARN ", "ERROR", "DEBUG", "INFO ", ""};
+void _log(log_level_e level, char *message) {
+    char *color_str[] = {"", color_red, color_red, color_yellow, ""};
+    char *level_str[] = {"", "ERROR", "WARN ", "INFO ", "DEBUG"};
 
     char buf[RCC_BUF_SIZE];
     bool tty = FALSE; // isatty(2);
 
-    if (src != NULL) {
-        snprintf(buf, RCC_BUF_SIZE, "%s%s: [%s:%d:%d] %s%s\n", tty? color_str[level]:"", level_str[level], src->filename, src->line, src->column, message, tty? color_white:"");
+    if (ctx && ctx->src != NULL) {
+        snprintf(buf, RCC_BUF_SIZE, "%s%s: [%s:%d:%d] %s%s\n", tty? color_str[level]:"", level_str[level], ctx->src->filename, ctx->src->line, ctx->src->column, message, tty? color_white:"");
     } else {
         snprintf(buf, RCC_BUF_SIZE, "%s%s: %s%s\n", tty? color_str[level]:"", level_str[level], message, tty? color_white:"");
     }
@@ -41,12 +71,27 @@ void _log(level_e level, char *message) {
 }
 
 void debug(char *fmt, ...) {
+    if (log_level < LOG_DEBUG) {
+        return;
+    }
     va_list va;
     va_start(va, fmt);
     char buf[RCC_BUF_SIZE];
     vsnprintf(buf, RCC_BUF_SIZE, fmt, va);
     va_end(va);
-    _log(DEBUG, buf);
+    _log(LOG_DEBUG, buf);
+}
+
+void info(char *fmt, ...) {
+    if (log_level < LOG_INFO) {
+        return;
+    }
+    va_list va;
+    va_start(va, fmt);
+    char buf[RCC_BUF_SIZE];
+    vsnprintf(buf, RCC_BUF_SIZE, fmt, va);
+    va_end(va);
+    _log(LOG_INFO, buf);
 }
 
 void error(char *fmt, ...) {
@@ -55,23 +100,37 @@ void error(char *fmt, ...) {
     char buf[RCC_BUF_SIZE];
     vsnprintf(buf, RCC_BUF_SIZE, fmt, va);
     va_end(va);
-    _log(ERROR, buf);
-    dump_tokens();
+    if (log_level >= LOG_ERROR) {
+        _log(LOG_ERROR, buf);
+
+        // the location of the error is always worth showing
+        int level = log_level;
+        log_level = max(log_level, LOG_INFO);
+        dump_tokens();
+        log_level = level;
+    }
+    if (ctx && ctx->error_exit) {
+        ctx->error_message = arena_strdup(buf);
+        longjmp(ctx->error_exit, 1);
+    }
     *(char *)0 = 0; // make segv for debug
     exit(1);
 }
 
 void warning(char *fmt, ...) {
+    if (log_level < LOG_WARN) {
+        return;
+    }
     va_list va;
     va_start(va, fmt);
     char buf[RCC_BUF_SIZE];
     vsnprintf(buf, RCC_BUF_SIZE, fmt, va);
     va_end(va);
-    _log(WARN, buf);
+    _log(LOG_WARN, buf);
 }
 
 char *_slice(char *src, int count) {
-    char *ret = malloc(count + 1);
+    char *ret = arena_alloc(count + 1);
     char *d = ret;
     for (;count>0;count--) {
         if (*src == 0) {
@@ -1,33 +1,40 @@
 #include "types.h"
 #include "rsys.h"
+#include "arena.h"
 #include "rstring.h"
 #include "devtool.h"
 #include "vec.h"
+#include "map.h"
 
-#include "token.h"
+#include "outbuf.h"
+
+#include "parse.h"
 
+#include "token.h"
+#include "file.h"
 #include "type.h"
 #include "var.h"
 #include "func.h"
 #include "atom.h"
 #include "gstr.h"
-
-#include "parse.h"
-
-int output_fd = 1;
-
-void _write(char *s) {
-    write(output_fd, s, strlen(s));
-}
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "trace.h"
+#include "context.h"
 
 void genf(char *fmt, ...) {
-    va_list va;
-    va_start(va, fmt);
-    char buf[RCC_BUF_SIZE];
-    vsnprintf(buf, RCC_BUF_SIZE, fmt, va);
-    va_end(va);
-    _write(buf);
-    _write("\n");
+    for (;;) {
+        va_list va;
+        va_start(va, fmt);
+        bool done = outbuf_vprintf(fmt, va);
+        va_end(va);
+        if (done) {
+            break;
+        }
+    }
+    outbuf_write("\n", 1);
+    ctx->emitted_lines++;
 }
 
 void gen_label(char *str) {
@@ -38,10 +45,8 @@ void gen(char *str) {
     genf("\t%s", str);
 }
 
-
-int label_index = 0;
 int new_label() {
-    return label_index++;
+    return ctx->label_index++;
 }
 
 typedef enum reg {
@@ -68,21 +73,11 @@ char *opsize(int size) {
     return (size == 8) ? "q" : (size == 4) ? "l" : (size == 1) ? "b" : "?";
 }
 
-int stack_offset = 0;
-
-/*
- * reg_in_use stores a status for the register.
- * 0: not in use (freely assignable)
- * 1: used
- * 2+: used and had 1+ pushed on the stack 
- */
-int reg_in_use[R_LAST];
-
 void dump_reg_is_use() {
     char b1[100] = {0}; 
     char b0[100] = {0}; 
     for(reg_e i=0; i<R_LAST; i++) { 
-        snprintf(b1, 100, "%d[%d] ", i, reg_in_use[i]); 
+        snprintf(b1, 100, "%d[%d] ", i, ctx->reg_in_use[i]); 
         strcat(b0, b1); 
     } 
     debug("before pop_all: %s", b0);
@@ -92,27 +87,36 @@ bool reg_is_callee_saved(reg_e i) {
     return (i==R_BX || i==R_12 || i==R_13 || i==R_14 || i==R_15);
 }
 
+/*
+ * reg_in_use stores a status for the register.
+ * 0: not in use (freely assignable)
+ * 1: used
+ * 2+: used and had 1+ pushed on the stack 
+ */
 void init_reg_in_use() {
+    if (!ctx->reg_in_use) {
+        ctx->reg_in_use = arena_alloc(R_LAST * sizeof(int));
+    }
     for (reg_e i=0; i<R_LAST; i++) {
-        reg_in_use[i] = reg_is_callee_saved(i) ? 1 : 0;
+        ctx->reg_in_use[i] = reg_is_callee_saved(i) ? 1 : 0;
     }
 }
 
 void emit_push(reg_e r) {
     genf(" pushq %s", reg(r,8));
-    stack_offset -= 8;
+    ctx->stack_offset -= 8;
 }
 
 void emit_pop(reg_e r) {
     genf(" popq %s", reg(r,8));
-    stack_offset += 8;
+    ctx->stack_offset += 8;
 }
 
 void reg_push_all() {
     for (reg_e i=0; i<R_LAST; i++) {
         if (i == R_AX) continue;
         if (reg_is_callee_saved(i)) continue;
-        if (reg_in_use[i]) {
+        if (ctx->reg_in_use[i]) {
             emit_push(i);
         }
     }
@@ -123,7 +127,7 @@ void reg_pop_all() {
         if (i == R_AX) continue;
         reg_e r = R_LAST-i-1;
         if (reg_is_callee_saved(r)) continue;
-        if (reg_in_use[r]) {
+        if (ctx->reg_in_use[r]) {
             emit_pop(r);
         }
     }
@@ -137,15 +141,15 @@ reg_e reg_assign_keep(reg_e keep) {
     int val_min = INT32_MAX;
     for (reg_e i=0; i<R_LAST; i++) {
         if (i == R_AX || i == keep) continue;
-        if (val_min > reg_in_use[i]) {
+        if (val_min > ctx->reg_in_use[i]) {
             reg_min = i;
-            val_min = reg_in_use[i];
+            val_min = ctx->reg_in_use[i];
         }
     }
-    if (reg_in_use[reg_min] > 0) {
+    if (ctx->reg_in_use[reg_min] > 0) {
         emit_push(reg_min);
     }
-    reg_in_use[reg_min]++;
+    ctx->reg_in_use[reg_min]++;
     return reg_min;
 }
 
@@ -154,13 +158,13 @@ reg_e reg_assign() {
 }
 
 void reg_release(reg_e r) {
-    if (!reg_in_use[r]) {
+    if (!ctx->reg_in_use[r]) {
         error("invalid release for reg %d", r);
     }
-    if (reg_in_use[r] > 1) {
+    if (ctx->reg_in_use[r] > 1) {
         emit_pop(r);
     }
-    reg_in_use[r]--;
+    ctx->reg_in_use[r]--;
 }
 
 reg_e reg_reserve(reg_e org, reg_e keep) {
@@ -180,18 +184,18 @@ void reg_restore(reg_e tmp, reg_e org, reg_e keep) {
     emit_pop(keep);
 }
 
-
 void emit_int(long val, int size, reg_e out) {
     genf(" mov%s $%ld, %s", opsize(size), val, reg(out, size));
 }
 
 void emit_string(char* str) {
-    char buf[RCC_BUF_SIZE] = {0};
-
-    strcat(buf, ".string \"");
-    escape_string(buf + strlen(buf), str);
-    strcat(buf, "\"");
-    gen(buf);
+    int size = strlen(str) * 2 + 1;
+    if (size > ctx->escape_cap) {
+        ctx->escape_cap = max(size, ctx->escape_cap * 2);
+        ctx->escape_buf = arena_alloc(ctx->escape_cap);
+    }
+    escape_string(ctx->escape_buf, str);
+    genf("\t.string \"%s\"", ctx->escape_buf);
 }
 
 void emit_global_ref(int i, reg_e out) {
@@ -291,8 +295,8 @@ void emit_array_index(int item_size, reg_e in, reg_e out) {
     reg_e in2 = reg_reserve(in, R_DX);
     genf(" movl $%d,%%eax", item_size);
     genf(" imulq %s", reg(in2,8));
+    reg_restore(in2, in, R_DX); // out may be %rdx, so add after restoring it
     genf(" addq %%rax, %s", reg(out,8));
-    reg_restore(in2, in, R_DX);
 }
 
 void emit_binop(char *binop, int size, reg_e in, reg_e out) {
@@ -310,8 +314,8 @@ void emit_mul(int size, reg_e in, reg_e inout) {
     reg_e in2 = reg_reserve(in, R_DX);
     genf(" mov%s %s,%s", opsize(size), reg(inout,size), reg(R_AX,size));
     genf(" imul%s %s", opsize(size), reg(in2,size));
+    reg_restore(in2, in, R_DX); // inout may be %rdx, so write the result after restoring it
     genf(" mov%s %s,%s", opsize(size), reg(R_AX,size), reg(inout,size));
-    reg_restore(in2, in, R_DX);
 }
 
 void emit_divmod(int size, reg_e in, reg_e out, reg_e ret_reg) { 
@@ -320,8 +324,11 @@ void emit_divmod(int size, reg_e in, reg_e out, reg_e ret_reg) {
     genf(" mov%s %s,%s", opsize(size), reg(out,size), reg(R_AX,size));
     genf(" %s", (size == 8) ? "cqo" : (size == 4) ? "cdq" : "???");
     genf(" idiv%s %s", opsize(size), reg(in2,size));
-    genf(" mov%s %s,%s", opsize(size), reg(ret_reg,size), reg(out,size));
-    reg_restore(in2, in, R_DX);
+    if (ret_reg != R_AX) {
+        genf(" mov%s %s,%s", opsize(size), reg(ret_reg,size), reg(R_AX,size));
+    }
+    reg_restore(in2, in, R_DX); // out may be %rdx, so write the result after restoring it
+    genf(" mov%s %s,%s", opsize(size), reg(R_AX,size), reg(out,size));
 }
 
 void emit_div(int size, reg_e in, reg_e out) {
@@ -383,7 +390,7 @@ void emit_jmp_ne(int i, int size, reg_e in1, reg_e in2) {
 int emit_push_struct(int size, reg_e from) {
     reg_e to = reg_assign();
     int offset = align(size, 8);
-    stack_offset += offset;
+    ctx->stack_offset += offset;
     genf(" subq $%d, %%rsp", offset);
     genf(" movq %%rsp, %s", reg(to, 8));
     emit_copy(size, from, to);
@@ -391,53 +398,44 @@ int emit_push_struct(int size, reg_e from) {
     return offset / 8;
 }
 
-
-int func_return_label;
-int func_void_return_label;
-
-typedef struct {
-    int break_label;
-    int continue_label;
-} break_label_t;
-
-VEC_HEADER(break_label_t, break_label_vec)
 VEC_BODY(break_label_t, break_label_vec)
 
-break_label_vec break_labels = 0;
-
 int get_break_label() {
-    if (!break_label_vec_len(break_labels)) {
+    if (!break_label_vec_len(ctx->break_labels)) {
         error("cannot emit break");
     }
-    return break_label_vec_top(break_labels)->break_label;
+    return break_label_vec_top(ctx->break_labels)->break_label;
 }
 int get_continue_label() {
-    if (!break_label_vec_len(break_labels)) {
+    if (!break_label_vec_len(ctx->break_labels)) {
         error("cannot emit break");
     }
-    return break_label_vec_top(break_labels)->continue_label;
+    return break_label_vec_top(ctx->break_labels)->continue_label;
 }
 void enter_break_label(int break_label, int continue_label) {
-    if (!break_labels) break_labels = break_label_vec_new();
+    if (!ctx->break_labels) ctx->break_labels = break_label_vec_new();
     break_label_t b;
     b.break_label = break_label;
     b.continue_label = continue_label;
-    break_label_vec_push(break_labels, b);
+    break_label_vec_push(ctx->break_labels, b);
 }
 void exit_break_label() {
-    if (!break_label_vec_len(break_labels)) {
+    if (!break_label_vec_len(ctx->break_labels)) {
         error("cannot exit break label");
     }
-    break_label_vec_pop(break_labels);
+    break_label_vec_pop(ctx->break_labels);
 }
 
-
 void compile(int pos, reg_e reg_out) {
-    atom_t *p = &(program[pos]);
-
-    char ast_text[RCC_BUF_SIZE] = {0};
-    dump_atom3(ast_text, p, 0, pos);
-    debug("compiling out:R#%d atom_t: %s", reg_out, ast_text);
+    atom_t *p = atom_at(pos);
+
+    char ast_text[RCC_BUF_SIZE]; // filled only when debugging
+    bool is_debug = (log_level >= LOG_DEBUG);
+    if (is_debug) {
+        ast_text[0] = '\0';
+        dump_atom3(ast_text, p, 0, pos);
+        debug("compiling out:R#%d atom_t: %s", reg_out, ast_text);
+    }
     set_token_pos(p->token_pos);
     //dump_token_by_id(p->token_pos);
 
@@ -477,10 +475,10 @@ void compile(int pos, reg_e reg_out) {
 
         case TYPE_CONVERT: {
             compile(p->atom_pos, reg_out);
-            int org_size = type_size(program[p->atom_pos].t);
+            int org_size = type_size(atom_at(p->atom_pos)->t);
             int new_size = type_size(p->t);
             if (!p->t->ptr_to && org_size < new_size) {
-                emit_scast(type_size(program[p->atom_pos].t), reg_out);
+                emit_scast(type_size(atom_at(p->atom_pos)->t), reg_out);
             }
             break;
         }
@@ -679,12 +677,12 @@ void compile(int pos, reg_e reg_out) {
             break;
 
         case TYPE_RETURN:
-            if (p->t != type_void) {
+            if (p->t != ctx->type_void) {
                 compile(p->atom_pos, reg_out);
                 genf(" movq %s, %%rax", reg(reg_out, 8));
-                emit_jmp(func_return_label);
+                emit_jmp(ctx->func_return_label);
             } else {
-                emit_jmp(func_void_return_label);
+                emit_jmp(ctx->func_void_return_label);
             }
             break;
         
@@ -697,7 +695,9 @@ void compile(int pos, reg_e reg_out) {
             break;
 
         case TYPE_APPLY: {
-            dump_atom_tree(pos,0);
+            if (is_debug) {
+                dump_atom_tree(pos,0);
+            }
             func *f = (func *)(p->ptr_value);
             int argc = (p+1)->int_value;
 
@@ -707,7 +707,7 @@ void compile(int pos, reg_e reg_out) {
             int struct_size[100]; 
             int stack_size = 0;
             for (int i=0; i<argc; i++) {
-                type_t *t = program[(p+i+2)->atom_pos].t;
+                type_t *t = atom_at((p+i+2)->atom_pos)->t;
                 if (t->struct_of) {
                     int size = type_size(t);
                     struct_size[i] = size;
@@ -730,7 +730,7 @@ void compile(int pos, reg_e reg_out) {
 
             // push for stack-passing
             reg_push_all();
-            if ((stack_size + stack_offset) % 16 != 0) {
+            if ((stack_size + ctx->stack_offset) % 16 != 0) {
                 genf(" subq $8, %%rsp");
                 stack_size += 8;
             }
@@ -787,7 +787,7 @@ void compile(int pos, reg_e reg_out) {
             int l_fallthrough = new_label();
             while (p->type == TYPE_ARG) {
                 int l_next_case = new_label(); 
-                atom_t *case_atom = &program[p->atom_pos];
+                atom_t *case_atom = atom_at(p->atom_pos);
                 int pos;
 
                 if (case_atom->type == TYPE_CASE) {
@@ -819,25 +819,27 @@ void compile(int pos, reg_e reg_out) {
         }
             break;
 
-
         default:
             dump_atom(pos, 0);
             error("Invalid program");
     }
-    if (p->type == TYPE_EXPR_STATEMENT || p->type == TYPE_APPLY || p->type == TYPE_RETURN || p->type == TYPE_IF || p->type == TYPE_FOR || p->type == TYPE_WHILE || p->type == TYPE_DO_WHILE) {
-        genf("# %s", ast_text);
+    if (is_debug) {
+        if (p->type == TYPE_EXPR_STATEMENT || p->type == TYPE_APPLY || p->type == TYPE_RETURN || p->type == TYPE_IF || p->type == TYPE_FOR || p->type == TYPE_WHILE || p->type == TYPE_DO_WHILE) {
+            genf("# %s", ast_text);
+        }
+        debug("compiled out:R#%d atom_t: %s", reg_out, ast_text);
     }
-    debug("compiled out:R#%d atom_t: %s", reg_out, ast_text);
 }
 
 void emit_function(func *f) {
     if (!f->body_pos) {
         return;
     }
-    set_token_pos(program[f->body_pos].token_pos);
+    set_token_pos(atom_at(f->body_pos)->token_pos);
+    trace_begin("function", f->name);
 
-    func_return_label = new_label();
-    func_void_return_label = new_label();
+    ctx->func_return_label = new_label();
+    ctx->func_void_return_label = new_label();
 
     genf(".globl %s", f->name);
     genf(".type %s, @function", f->name);
@@ -846,7 +848,7 @@ void emit_function(func *f) {
     genf(" movq %%rsp, %%rbp");
 
     genf(" subq $%d, %%rsp", align(f->max_offset, 16));
-    stack_offset = 0; // at this point, %rsp must be 16-bytes aligned
+    ctx->stack_offset = 0; // at this point, %rsp must be 16-bytes aligned
     init_reg_in_use();
 
     int arg_offset = 0;
@@ -890,26 +892,27 @@ void emit_function(func *f) {
     reg_e ret = reg_assign();
     compile(f->body_pos, ret);
 
-    emit_label(func_void_return_label);
+    emit_label(ctx->func_void_return_label);
     genf(" xorq %%rax, %%rax"); // set default return value to $0
-    emit_label(func_return_label);
+    emit_label(ctx->func_return_label);
     genf(" leave");
     genf(" ret");
     genf("");
+    trace_end();
 }
 
 int emit_global_constant_by_type(type_t *pt, int value) {
     int filled_size = 0;
-    if (pt == type_char) {
+    if (pt == ctx->type_char) {
         genf(".byte %d", value);
         filled_size += 1;
-    } else if (pt == type_int) {
+    } else if (pt == ctx->type_int) {
         genf(".long %d", value);
         filled_size += 4;
-    } else if (pt == type_long) {
+    } else if (pt == ctx->type_long) {
         genf(".quad %d", value);
         filled_size += 4;
-    } else if (pt == type_char_ptr) {
+    } else if (pt == ctx->type_char_ptr) {
         genf(".quad .G%d", value);
         filled_size += 8;
     } else if (pt->ptr_to) {
@@ -951,12 +954,7 @@ void emit_global_declaration(var_t *v) {
     genf(".comm %s, %d", v->name, type_size(v->t));
 }
 
-void compile_file(int fd) {
-    output_fd = fd;
-    
-    gen(".file \"main.c\"");
-    gen("");
-
+void emit_global_vars() {
     var_vec vars = get_global_frame()->vars;
     for (int i=0; i<var_vec_len(vars); i++) {
         var_t *v = var_vec_get(vars, i);
@@ -969,8 +967,9 @@ void compile_file(int fd) {
             emit_global_declaration(v);
         }
     }
+}
 
-    gen(".text");
+void emit_global_strings() {
     gen(".section .rodata");
 
     int gstr_i=0;
@@ -981,16 +980,62 @@ void compile_file(int fd) {
         gstr_i++;
     }
     gen("");
+}
+
+void compile_file(int fd) {
+    outbuf_open(fd);
+    ctx->emitted_lines = 0;
+
+    gen(".file \"main.c\"");
+    gen("");
+
+    emit_global_vars();
+
+    gen(".text");
+    emit_global_strings();
 
     gen(".text");
     gen("");
 
-    for (int i=0; i<func_vec_len(functions); i++) {
-        func *f = func_vec_get(functions, i);
+    for (int i=0; i<func_vec_len(ctx->functions); i++) {
+        func *f = func_vec_get(ctx->functions, i);
         if (f->body_pos != 0) {
             debug("%s --------------------- ", f->name);
             //dump_atom_tree(f->body_pos, 0);
             emit_function(f);
         }
     }
+    outbuf_flush();
+    info("emitted %d lines with %d write calls", ctx->emitted_lines, outbuf_write_count());
+}
+
+void stream_open(int fd) {
+    outbuf_open(fd);
+    ctx->emitted_lines = 0;
+    ctx->streaming = TRUE;
+
+    gen(".file \"main.c\"");
+    gen("");
+    gen(".text");
+    gen("");
+}
+
+/*
+ * emits the function just parsed, then releases its atoms allocated since the mark
+ */
+void stream_function(func *f, int mark) {
+    debug("%s --------------------- ", f->name);
+    int token_pos = get_token_pos(); // emit_function() moves it for the messages
+    emit_function(f);
+    set_token_pos(token_pos);
+    f->body_pos = 0;
+    atom_release(mark);
+}
+
+void stream_close() {
+    emit_global_vars();
+    emit_global_strings();
+    outbuf_flush();
+    ctx->streaming = FALSE;
+    info("emitted %d lines with %d write calls", ctx->emitted_lines, outbuf_write_count());
 }
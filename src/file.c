@@ -1,24 +1,42 @@
 #include "types.h"
 #include "rsys.h"
+#include "arena.h"
 #include "rstring.h"
 #include "devtool.h"
 #include "vec.h"
+#include "map.h"
 
+#include "token.h"
 #include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "librcc.h"
+#include "context.h"
 
-#define SIZE_FILE_BUF (1024*1024)
 
-VEC_HEADER(src_t, src_vec)
-VEC_BODY(src_t, src_vec)
+#define SIZE_READ_BUF (64*1024)
 
-src_t *src;
-src_vec srcs = 0;
-int_vec src_id_stack = 0;
-char_p_vec include_dirs = 0;
+#define SEEK_SET 0
+#define SEEK_END 2
+#define PROT_READ 1
+#define MAP_PRIVATE 2
+
+VEC_INLINE_BODY(src_t, src_vec)
+
+typedef struct {
+    char *body;
+    int len;
+} memory_file_t;
 
 void add_include_dir(char *dir) {
-    if (include_dirs == 0) include_dirs = char_p_vec_new();
-    char_p_vec_push(include_dirs, dir);
+    if (ctx->include_dirs == 0) ctx->include_dirs = char_p_vec_new();
+    char_p_vec_push(ctx->include_dirs, dir);
 }
 
 void dirname(char *out, char*path) {
@@ -37,64 +55,208 @@ void dirname(char *out, char*path) {
 }
 
 src_t *get_current_file() {
-    if (int_vec_len(src_id_stack) == 0) {
+    if (int_vec_len(ctx->src_id_stack) == 0) {
         return 0;
     }
-    return src_vec_get(srcs, *int_vec_top(src_id_stack));
+    return src_vec_get(ctx->srcs, *int_vec_top(ctx->src_id_stack));
 }
 
-int open_include_file(char *filename) {
-    int i;
-    for (i=0; i<char_p_vec_len(include_dirs); i++) {
-        char path[RCC_BUF_SIZE] = {0};
-        strcat(path, *char_p_vec_get(include_dirs, i));
-        strcat(path, "/");
-        strcat(path, filename);
-        int fd = open(path, 0);
-        if (fd >= 0) {
-            return fd;
-        }
-        debug("include file not found at:%s", path);
-    };
-    return -1;
+/*
+ * makes the file at path read from the body instead. the body is not copied
+ */
+void add_memory_file(char *path, char *body, int len) {
+    if (!ctx->memory_files) {
+        ctx->memory_files = str_map_new();
+    }
+    memory_file_t *m = arena_alloc(sizeof(memory_file_t));
+    m->body = body;
+    m->len = len;
+    str_map_put(ctx->memory_files, path, m);
 }
 
-char *load_file(char *filename) {
-    char *buf = calloc(SIZE_FILE_BUF,1);
+memory_file_t *get_memory_file(char *path) {
+    if (!ctx->memory_files) {
+        return NULL;
+    }
+    return str_map_get(ctx->memory_files, path);
+}
 
-    int fd;
+bool is_memory_file(char *path) {
+    return get_memory_file(path) != NULL;
+}
 
-    if (srcs == 0) srcs = src_vec_new();
-    if (src_vec_len(srcs) == 0) {
-        char *b = calloc(1, RCC_BUF_SIZE);
+/*
+ * asks the include resolver of rcc_compile() for the file, and keeps what it gives as a memory file
+ */
+bool resolve_include(char *filename) {
+#ifdef __GNUC__
+    if (ctx->include_resolver) {
+        rcc_include_resolver_t resolver = ctx->include_resolver;
+        long len;
+        char *body = resolver(ctx->include_resolver_data, filename, &len);
+        if (body) {
+            if (len > INT32_MAX) {
+                error("too large include file: %s", filename);
+            }
+            add_memory_file(arena_strdup(filename), body, len);
+            return TRUE;
+        }
+    }
+#endif
+    return FALSE;
+}
+
+/*
+ * returns the path of the file, searching the include dirs for an include file, or NULL if not found
+ */
+char *find_file(char *filename) {
+    if (ctx->srcs == 0) ctx->srcs = src_vec_new();
+    if (src_vec_len(ctx->srcs) == 0) {
+        char *b = arena_alloc(RCC_BUF_SIZE);
         dirname(b, filename);
         add_include_dir(b);
-        fd = open(filename, 0);
-    } else {
-        fd = open_include_file(filename);
+        ctx->include_paths = str_map_new();
+        ctx->include_guards = str_map_new();
+        return filename;
+    }
+
+    char *path = str_map_get(ctx->include_paths, filename);
+    if (path) {
+        return path;
+    }
+    if (is_memory_file(filename) || resolve_include(filename)) {
+        return filename;
+    }
+    for (int i=0; i<char_p_vec_len(ctx->include_dirs); i++) {
+        char buf[RCC_BUF_SIZE];
+        buf[0] = '\0';
+        strcat(buf, *char_p_vec_get(ctx->include_dirs, i));
+        strcat(buf, "/");
+        strcat(buf, filename);
+        if (access(buf, 0) == 0) {
+            path = arena_strdup(buf);
+            str_map_put(ctx->include_paths, arena_strdup(filename), path);
+            return path;
+        }
+        debug("include file not found at:%s", buf);
+    }
+    return NULL;
+}
+
+/*
+ * marks the file to be skipped when it is included again while the guard macro is defined.
+ * an empty guard is for '#pragma once', which always skips.
+ */
+void set_include_guard(char *path, char *guard) {
+    str_map_put(ctx->include_guards, path, guard);
+}
+
+/*
+ * returns the guard macro set by set_include_guard(), or NULL
+ */
+char *get_include_guard(char *path) {
+    return str_map_get(ctx->include_guards, path);
+}
+
+/*
+ * reads until EOF, for files which cannot be mapped (e.g. pipes)
+ */
+char *read_file(int fd, int *len) {
+    int cap = SIZE_READ_BUF;
+    char *buf = arena_alloc(cap);
+    *len = 0;
+    for (;;) {
+        if (*len == cap) {
+            buf = arena_realloc(buf, cap, cap * 2);
+            cap *= 2;
+        }
+        int n = read(fd, buf + *len, cap - *len);
+        if (n < 0) {
+            return 0;
+        }
+        if (n == 0) {
+            break;
+        }
+        *len += n;
     }
+    return buf;
+}
 
+/*
+ * maps the whole file read-only. the body is not null-terminated; use src_t.len.
+ * the mapping lasts until unmap_file() or the end of the context
+ */
+char *map_file(int fd, int *len) {
+    long size = lseek(fd, 0, SEEK_END);
+    if (size < 0) {
+        return read_file(fd, len);
+    }
+    if (size > INT32_MAX) {
+        return 0;
+    }
+    *len = size;
+    if (size == 0) {
+        return "";
+    }
+    char *buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if ((long)buf == -1) {
+        lseek(fd, 0, SEEK_SET);
+        return read_file(fd, len);
+    }
+    if (!ctx->mapped_bodies) {
+        ctx->mapped_bodies = vec_new();
+        ctx->mapped_lens = int_vec_new();
+    }
+    vec_push(ctx->mapped_bodies, buf);
+    int_vec_push(ctx->mapped_lens, *len);
+    return buf;
+}
+
+/*
+ * releases a body returned by map_file() before the end of the context
+ */
+void unmap_file(char *body) {
+    if (!ctx->mapped_bodies) {
+        return; // read, not mapped
+    }
+    for (int i=vec_len(ctx->mapped_bodies)-1; i>=0; i--) {
+        if (*vec_get(ctx->mapped_bodies, i) == body) {
+            munmap(body, *int_vec_get(ctx->mapped_lens, i));
+            vec_set(ctx->mapped_bodies, i, NULL); // keeps the indexes of mapped_lens
+            return;
+        }
+    }
+}
+
+char *load_file(char *path, int *len) {
+    memory_file_t *m = get_memory_file(path);
+    if (m) {
+        *len = m->len;
+        return m->body;
+    }
+
+    int fd = open(path, 0);
     if (fd == -1) {
-        error("cannot open include file: %s", filename);
+        error("cannot open include file: %s", path);
     }
 
-    int len = read(fd, buf, SIZE_FILE_BUF);
+    char *buf = map_file(fd, len);
+    if (!buf) {
+        error("cannot read file: %s", path);
+    }
     if (close(fd)) {
         debug("closing fd: %d", fd);
-        error("error on closing file: %s", filename);
+        error("error on closing file: %s", path);
     }
 
-    buf = realloc(buf, len + 1);
-    buf[len] = '\0';
-
-    debug("loaded: %s", filename);
+    debug("loaded: %s (%d bytes)", path, *len);
     return buf;
 }
 
 bool enter_new_file(char *filename, char *body, int pos, int len, int line, int column) {
-    src_t *s = src_vec_extend(srcs, 1);
+    src_t *s = src_vec_extend(ctx->srcs, 1);
 
-    s->id = src_vec_len(srcs) - 1;
+    s->id = src_vec_len(ctx->srcs) - 1;
     s->filename = filename;
     s->body = body;
 
@@ -107,37 +269,94 @@ bool enter_new_file(char *filename, char *body, int pos, int len, int line, int
     s->prev_column = 1;
     s->prev_pos = 0;
 
-    if (!src_id_stack) src_id_stack = int_vec_new();
-    int_vec_push(src_id_stack, s->id);
-    src = get_current_file();
+    if (!ctx->src_id_stack) ctx->src_id_stack = int_vec_new();
+    int_vec_push(ctx->src_id_stack, s->id);
+    ctx->src = get_current_file();
 
-    debug("entered to file:%s #%d %x len:%d", src->filename, src->id, src->filename, src->len);
+    debug("entered to file:%s #%d %x len:%d", ctx->src->filename, ctx->src->id, ctx->src->filename, ctx->src->len);
     //dump_file_stack();
 
     return TRUE;
 }
 
+/*
+ * registers a text as a source without entering it, and returns its id
+ */
+int add_src(char *filename, char *path, char *body, int len) {
+    src_t *s = src_vec_extend(ctx->srcs, 1);
+    s->id = src_vec_len(ctx->srcs) - 1;
+    s->filename = filename;
+    s->path = path;
+    s->body = body;
+    s->len = len;
+    s->line = 1;
+    s->column = 1;
+    s->prev_line = 1;
+    s->prev_column = 1;
+    ctx->src = get_current_file(); // srcs may have been moved
+    return s->id;
+}
+
+/*
+ * gets the size and the modification time (in ns) of the file. returns FALSE if it does not exist
+ */
+bool file_stat(char *path, long *size, long *mtime) {
+    long st[18]; // struct stat on x86_64
+    if (stat(path, st) != 0) {
+        return FALSE;
+    }
+    *size = st[6];
+    *mtime = st[11] * 1000000000 + st[12];
+    return TRUE;
+}
+
+/*
+ * a multiply-xor hash in the manner of FNV-1a, on a signed long. the offset basis is not the
+ * reference one, which does not fit a long, so the values do not match a reference FNV-1a
+ */
+long hash_bytes(char *p, int len) {
+    long h = 1469598103934665603;
+    for (int i=0; i<len; i++) {
+        int c = p[i];
+        h = (h ^ (c & 255)) * 1099511628211;
+    }
+    return h;
+}
+
 bool enter_file(char *filename) {
-    char *buf = load_file(filename);
-    return enter_new_file(filename, buf, 0, strlen(buf), 1, 1);
+    return enter_file_path(filename, find_file(filename));
+}
+
+/*
+ * path is the result of find_file(filename)
+ */
+bool enter_file_path(char *filename, char *path) {
+    int len;
+    if (!path) {
+        error("cannot open include file: %s", filename);
+    }
+    char *buf = load_file(path, &len);
+    enter_new_file(filename, buf, 0, len, 1, 1);
+    ctx->src->path = path;
+    return TRUE;
 }
 
 bool exit_file() {
-    if (int_vec_len(src_id_stack) == 0) {
+    if (int_vec_len(ctx->src_id_stack) == 0) {
         error("invalid exit from the root file");
     }
-    debug("exiting file #%d:%s %x", src->id, src->filename, src->filename);
+    debug("exiting file #%d:%s %x", ctx->src->id, ctx->src->filename, ctx->src->filename);
     //dump_file_stack();
 
-    int_vec_pop(src_id_stack);
-    src = get_current_file();
+    int_vec_pop(ctx->src_id_stack);
+    ctx->src = get_current_file();
     return TRUE;
 }
 
 void dump_file_stack() {
-    for(int i=0; i<int_vec_len(src_id_stack); i++) {
-        int id = *int_vec_get(src_id_stack, i);
-        debug("stack:%d id:%d name:%s %d, %s", i, id, src_vec_get(srcs,id)->filename, src_vec_get(srcs, id), src == src_vec_get(srcs, id) ? "<--" : "");
+    for(int i=0; i<int_vec_len(ctx->src_id_stack); i++) {
+        int id = *int_vec_get(ctx->src_id_stack, i);
+        debug("stack:%d id:%d name:%s %d, %s", i, id, src_vec_get(ctx->srcs,id)->filename, src_vec_get(ctx->srcs, id), ctx->src == src_vec_get(ctx->srcs, id) ? "<--" : "");
     }
 }
 
@@ -149,14 +368,17 @@ char char_to_printable(char c) {
  * display the part of the file in 1-line style, sorrounded by '=>' and '<='
  */
 char *dump_file(int id, int start_pos, int end_pos) {
-    if (start_pos > end_pos) {
+    if (src_vec_get(ctx->srcs, id) == 0) {
+        return "* invalid id *";
+    }
+    if (end_pos >= src_vec_get(ctx->srcs, id)->len) {
+        end_pos = src_vec_get(ctx->srcs, id)->len - 1; // the body is not null-terminated
+    }
+    if (start_pos > end_pos || start_pos < 0) {
         return "* invalid pos for dump_file *";
     }
     int line_start_pos = start_pos;
-    if (src_vec_get(srcs, id) == 0) {
-        return "* invalid id *";
-    }
-    char *body = src_vec_get(srcs, id)->body;
+    char *body = src_vec_get(ctx->srcs, id)->body;
 
     while ((line_start_pos >= 0) && (body[line_start_pos] != '\n') && (start_pos - line_start_pos < 40)) {
         line_start_pos--;
@@ -164,13 +386,13 @@ char *dump_file(int id, int start_pos, int end_pos) {
     line_start_pos++;
 
     int line_end_pos = end_pos;
-    while (line_end_pos < src_vec_get(srcs, id)->len && body[line_end_pos] != '\n' && line_end_pos - end_pos < 40) {
+    while (line_end_pos < src_vec_get(ctx->srcs, id)->len && body[line_end_pos] != '\n' && line_end_pos - end_pos < 40) {
         line_end_pos++;
     }
 
     int line_size = line_end_pos - line_start_pos + 1;
 
-    char *buf = calloc(1, line_size + 4 + 4 + 1 + 10);
+    char *buf = arena_alloc(line_size + 4 + 4 + 1 + 10);
     char *p = buf;
     int i = line_start_pos;
     while (i < start_pos) { 
@@ -195,9 +417,12 @@ char *dump_file(int id, int start_pos, int end_pos) {
 }
 
 char *file_get_part(int id, int start_pos, int end_pos) {
-    char *body = src_vec_get(srcs, id)->body;
+    char *body = src_vec_get(ctx->srcs, id)->body;
+    if (end_pos >= src_vec_get(ctx->srcs, id)->len) {
+        end_pos = src_vec_get(ctx->srcs, id)->len - 1;
+    }
     int line_size = end_pos - start_pos + 1;
-    char *buf = calloc(1, line_size + 3 + 5 + 5 + 2);
+    char *buf = arena_alloc(line_size + 3 + 5 + 5 + 2);
     char *p = buf;
     int i = start_pos;
     while (i <= end_pos) {
@@ -207,41 +432,45 @@ char *file_get_part(int id, int start_pos, int end_pos) {
 }
 
 src_t *file_info(int id) {
-    return src_vec_get(srcs,id);
+    return src_vec_get(ctx->srcs,id);
+}
+
+int src_count() {
+    return src_vec_len(ctx->srcs);
 }
 
 bool is_eof() {
-    return src->pos >= src->len;
+    return ctx->src->pos >= ctx->src->len;
 }
 
 int ch() {
     if (is_eof()) {
         return -1;
     }
-    return src->body[src->pos];
+    return ctx->src->body[ctx->src->pos];
 }
 
 int ch_next() {
-    if (src->pos+1 >= src->len) {
+    if (ctx->src->pos+1 >= ctx->src->len) {
         return -1;
     }
-    return src->body[src->pos+1];
+    return ctx->src->body[ctx->src->pos+1];
 }
 
 bool next() {
     if (is_eof()) return FALSE;
 
     if (ch() == '\n') {
-        src->column = 1;
-        src->line++;
+        ctx->src->column = 1;
+        ctx->src->line++;
     }
-    src->pos++;
-    src->column++;
+    ctx->src->pos++;
+    ctx->src->column++;
 
     while (ch() == '\\' && ch_next() == '\n') {
-        src->pos+=2;
-        src->line++;
-        src->column = 1;
+        ctx->src->pos+=2;
+        ctx->src->line++;
+        ctx->src->column = 1;
     }
     return TRUE;
 }
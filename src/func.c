@@ -3,25 +3,30 @@
 #include "rstring.h"
 #include "devtool.h"
 #include "rsys.h"
+#include "arena.h"
 #include "vec.h"
+#include "intern.h"
+#include "map.h"
 
+#include "token.h"
+#include "file.h"
 #include "type.h"
 #include "var.h"
-
 #include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
 
 VEC_BODY(func, func_vec)
 
-func_vec functions = 0;
-
 func *find_func_name(char *name) {
-    for (int i=0; i<func_vec_len(functions); i++) {
-        func *f = func_vec_get(functions, i);
-        if (!strcmp(f->name, name)) {
-            return f;
-        }
+    if (!ctx->function_names) {
+        return 0;
     }
-    return 0;
+    return str_map_get(ctx->function_names, name);
 }
 
 func *find_function(char *name, type_t *ret_type, int argc, var_vec argv) {
@@ -45,11 +50,14 @@ func *find_function(char *name, type_t *ret_type, int argc, var_vec argv) {
 }
 
 func *add_function(char *name, type_t *ret_type, bool is_external, bool is_variadic, int argc, var_vec argv) {
-    if (!functions) functions = func_vec_new();
+    if (!ctx->functions) {
+        ctx->functions = func_vec_new();
+        ctx->function_names = str_map_new();
+    }
     func *f = find_function(name, ret_type, argc, argv);
     if (!f) {
         func fn;
-        fn.name = name;
+        fn.name = intern(name);
         fn.ret_type = ret_type;
         fn.argc = argc;
         fn.argv = argv;
@@ -57,7 +65,8 @@ func *add_function(char *name, type_t *ret_type, bool is_external, bool is_varia
         fn.is_variadic = is_variadic;
         fn.max_offset = 0;
         fn.body_pos = 0;
-        f = func_vec_push(functions, fn);
+        f = func_vec_push(ctx->functions, fn);
+        str_map_put(ctx->function_names, f->name, f);
     }
     debug("added function: %s", f->name);
     return f;
@@ -1,46 +1,58 @@
 #include "types.h"
 #include "rsys.h"
+#include "arena.h"
 #include "rstring.h"
 #include "devtool.h"
 #include "vec.h"
+#include "map.h"
 
-char_p_vec gstrings = 0;
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
 
 int add_global_string(char *name) {
-    if (!gstrings) gstrings = char_p_vec_new();
-    for (int i=0; i<char_p_vec_len(gstrings); i++) {
-        if (!strcmp(name, *char_p_vec_get(gstrings,i))) {
-            return i;
-        }
+    if (!ctx->gstrings) ctx->gstrings = char_p_vec_new();
+    if (!ctx->gstring_index) ctx->gstring_index = str_map_new();
+
+    long index = (long)str_map_get(ctx->gstring_index, name);
+    if (index) {
+        return (int)index - 1;
     }
-    char_p_vec_push(gstrings, name);
-    return char_p_vec_len(gstrings) - 1;
+    char_p_vec_push(ctx->gstrings, name);
+    index = char_p_vec_len(ctx->gstrings);
+    str_map_put(ctx->gstring_index, name, (void *)index);
+    return (int)index - 1;
 }
 
 char *find_global_string(int index) {
-    if (!gstrings) gstrings = char_p_vec_new();
-    char **result = char_p_vec_get(gstrings, index);
+    if (!ctx->gstrings) ctx->gstrings = char_p_vec_new();
+    char **result = char_p_vec_get(ctx->gstrings, index);
     return (result) ? *result : 0;
 }
 
-VEC_HEADER(int_vec, int_vec_vec)
 VEC_BODY(int_vec, int_vec_vec)
 
-int_vec_vec global_array = 0;
-
 int alloc_global_array() {
-    if (!global_array) global_array = int_vec_vec_new();
+    if (!ctx->global_array) ctx->global_array = int_vec_vec_new();
     
-    int_vec_vec_push(global_array, int_vec_new());
-    return int_vec_vec_len(global_array) - 1;
+    int_vec_vec_push(ctx->global_array, int_vec_new());
+    return int_vec_vec_len(ctx->global_array) - 1;
 }
 
 void add_global_array(int pos, int value) {
-    int_vec_push(*int_vec_vec_get(global_array, pos), value);
+    int_vec_push(*int_vec_vec_get(ctx->global_array, pos), value);
 }
 
 int get_global_array_length(int pos) {
-    int_vec *item = int_vec_vec_get(global_array, pos);
+    int_vec *item = int_vec_vec_get(ctx->global_array, pos);
     if (!item) {
         error("global array index out of range:%d", pos);
     }
@@ -48,7 +60,7 @@ int get_global_array_length(int pos) {
 }
 
 int get_global_array(int pos, int offset) {
-    int_vec *item = int_vec_vec_get(global_array, pos);
+    int_vec *item = int_vec_vec_get(ctx->global_array, pos);
     if (!item) {
         error("global array pos out of range:%d", pos);
     }
@@ -0,0 +1,36 @@
+#include "types.h"
+#include "rsys.h"
+#include "arena.h"
+#include "rstring.h"
+#include "map.h"
+#include "vec.h"
+
+#include "intern.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
+char *intern(const char *str) {
+    if (!ctx->interned) ctx->interned = str_map_new();
+
+    char *s = str_map_get(ctx->interned, str);
+    if (!s) {
+        s = arena_strdup(str);
+        str_map_put(ctx->interned, s, s);
+    }
+    return s;
+}
+
+int intern_count() {
+    if (!ctx->interned) return 0;
+    return ctx->interned->len;
+}
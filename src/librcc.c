@@ -0,0 +1,79 @@
+#include "types.h"
+#include "rsys.h"
+#include "arena.h"
+#include "devtool.h"
+#include "rstring.h"
+#include "vec.h"
+#include "map.h"
+
+#include "outbuf.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "parse.h"
+#include "librcc.h"
+#include "context.h"
+
+extern void add_include_dir(char *);
+
+/*
+ * hands a malloc'ed copy of the text to the caller, and drops the context of the compile
+ */
+int rcc_finish(context_t *prev, int status, char *text, int len, char **out, long *out_len) {
+    char *copy = malloc(len + 1);
+    if (!copy) {
+        error("cannot allocate the output of %d bytes", len);
+    }
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    *out = copy;
+    *out_len = len;
+
+    context_free(ctx);
+    context_use(prev);
+    return status;
+}
+
+int rcc_compile(const char *src, long len, rcc_options_t *options, char **out, long *out_len) {
+    context_t *prev = context_use(context_new());
+
+    long env[JMP_BUF_LONGS];
+    if (_setjmp(env)) {
+        return rcc_finish(prev, 1, ctx->error_message, strlen(ctx->error_message), out, out_len);
+    }
+    ctx->error_exit = env;
+
+    char *filename = "input.c";
+    if (options) {
+        if (options->filename) {
+            filename = options->filename;
+        }
+        if (options->include_dirs) {
+            for (char **dir = options->include_dirs; *dir; dir++) {
+                add_include_dir(*dir);
+            }
+        }
+        ctx->include_resolver = options->include_resolver;
+        ctx->include_resolver_data = options->include_resolver_data;
+    }
+    if (len > INT32_MAX) {
+        error("too large source: %ld bytes", len);
+    }
+    add_memory_file(filename, (char *)src, len);
+
+    tokenize_file(filename);
+    parse();
+    compile_file(-1);
+
+    int asm_len;
+    char *asm_text = outbuf_contents(&asm_len);
+    return rcc_finish(prev, 0, asm_text, asm_len, out, out_len);
+}
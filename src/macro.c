@@ -1,235 +1,346 @@
 #include "types.h"
 #include "rsys.h"
+#include "arena.h"
 #include "devtool.h"
 #include "rstring.h"
 #include "vec.h"
+#include "map.h"
+#include "intern.h"
 
+#include "token.h"
 #include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
 #include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "trace.h"
+#include "context.h"
+
+
+/*
+ * hashes the params and the body tokens of a macro, to tell if a definition has changed.
+ * 0 is reserved for 'not defined'
+ */
+long macro_hash(macro_t *m) {
+    long h = m->nparams;
+    if (m->is_function) {
+        h = h + 1000;
+    }
+    for (int i=0; i<m->body_len; i++) {
+        token *t = &m->body[i];
+        int id = t->id;
+        long v = t->int_value;
+        if (t->id == T_IDENT || t->id == T_STRING) {
+            v = str_map_hash(t->str_value);
+        } else if (t->id == T_UINT64) {
+            v = t->long_value;
+        } else if (t->id == T_CHAR) {
+            v = t->char_value;
+        } else if (t->id != T_UINT32 && t->id != T_MACRO_PARAM) {
+            v = 0;
+        }
+        h = (h * 31 + id) * 31 + v;
+    }
+    if (h == 0) {
+        h = 1; // 0 is for 'not defined'
+    }
+    return h;
+}
 
-VEC_HEADER(macro_t, macro_vec)
-VEC_BODY(macro_t, macro_vec)
-
-macro_vec macros = 0;
-
-void add_macro(const char *name, int start_pos, int end_pos, char_p_vec vars) {
-    if (macros == 0) {
-        macros = macro_vec_new();
+/*
+ * body is copied into the arena
+ */
+void add_macro(const char *name, bool is_function, int nparams, token *body, int body_len) {
+    if (!ctx->macros) {
+        ctx->macros = str_map_new();
+        ctx->macro_work = token_vec_new();
+    }
+    if (nparams > MACRO_MAX_ARGS) {
+        error("too many macro args: %s", name);
+    }
+    macro_t *m = arena_alloc(sizeof(macro_t));
+    m->name = intern(name);
+    m->nparams = nparams;
+    m->body = arena_alloc(body_len * sizeof(token));
+    m->body_len = body_len;
+    for (int i=0; i<body_len; i++) {
+        m->body[i] = body[i];
+    }
+    m->is_function = is_function;
+    m->expanding = FALSE;
+    m->hash = macro_hash(m);
+    str_map_put(ctx->macros, m->name, m);
+    if (ctx->pch_recording) {
+        pch_note_define(m);
     }
-    macro_t *m = macro_vec_extend(macros, 1);
-    m->name = strdup(name);
-    m->src = src;
-    m->start_pos = start_pos;
-    m->end_pos = end_pos;
-    m->vars = vars;
 
-    debug("added macro: %s as |%s|" , name, dump_file(src->id, start_pos, end_pos));
-    for (int i=0; i<m->vars->len; i++) {
-        debug(" args:%d %s", i, *char_p_vec_get(m->vars, i));
+    if (log_level >= LOG_DEBUG) {
+        debug("added macro: %s with %d params, %d tokens", name, nparams, body_len);
     }
 }
 
 void delete_macro(const char *name) {
-    macro_t *m = find_macro(name);
-    if (!m) {
+    if (!ctx->macros || !str_map_delete(ctx->macros, name)) {
         error("delete_macro: not found %s", name);
     }
-    m->name = "";
+    if (ctx->pch_recording) {
+        pch_note_undef(name);
+    }
 }
 
 macro_t *find_macro(const char *name) {
-    for (int i=0; i<macro_vec_len(macros); i++) {
-        macro_t *m = macro_vec_get(macros,i);
-        if (strcmp(m->name, name) == 0) {
-            return m;
-        }
+    macro_t *m = NULL;
+    if (ctx->macros) {
+        m = str_map_get(ctx->macros, name);
     }
-    return 0;
+    if (ctx->pch_recording) {
+        pch_note_lookup(name, m);
+    }
+    return m;
 }
 
-extern bool exit_file();
-
-extern bool tokenize_ident(char **p);
-extern bool skip();
-extern bool accept_string(char *);
-
-typedef struct {
-    macro_t *m;
-    macro_vec args;
-} macro_frame_t;
-
-VEC_HEADER(macro_frame_t, macro_frame_vec)
-VEC_BODY(macro_frame_t, macro_frame_vec)
-
-macro_frame_vec macro_frames = 0;
+/*
+ * returns TRUE if the j-th body token is an operand of '##'
+ */
+bool is_paste_operand(macro_t *m, int j) {
+    if (j > 0 && m->body[j - 1].id == T_PASTE) {
+        return TRUE;
+    }
+    if (j < m->body_len - 1 && m->body[j + 1].id == T_PASTE) {
+        return TRUE;
+    }
+    return FALSE;
+}
 
-bool is_in_expanding(const char *name) {
-    for (int i=0; i<macro_frame_vec_len(macro_frames); i++) {
-        if (strcmp(macro_frame_vec_get(macro_frames,i)->m->name, name) == 0) {
+/*
+ * returns TRUE if the k-th parameter appears in the body other than as an operand of '##',
+ * which is where the fully expanded argument is needed
+ */
+bool needs_expanded_arg(macro_t *m, int k) {
+    for (int j=0; j<m->body_len; j++) {
+        token *t = &m->body[j];
+        if (t->id == T_MACRO_PARAM && t->int_value == k && !is_paste_operand(m, j)) {
             return TRUE;
         }
     }
     return FALSE;
 }
 
-void read_macro_arg(int *spos, int *epos, bool is_last_arg) {
-    char_vec paren_stack = char_vec_new();
-    skip();
-    *spos = src->pos;
-    *epos = src->pos;
-    for(;;) {
-        int c = ch();
-        //debug("read: %c %d %c %c %c", c, paren_stack->len, paren_stack->items[0], paren_stack->items[1], paren_stack->items[2]);
-
-        if (c == '[' || c == '(') {
-            char_vec_push(paren_stack, c);
-        } else if (c == ']') {
-            if (paren_stack->len == 0 || *char_vec_pop(paren_stack) != '[') error("stray ']' in macro args");
-        } else if (c == ')') {
-            if (paren_stack->len == 0 && is_last_arg) break;
-            if (paren_stack->len == 0 || *char_vec_pop(paren_stack) != '(') error("stray ')' in macro args");
-        } else if (c == ',') {
-            if (paren_stack->len == 0 && !is_last_arg) break;
-        } else if (c == '"') {
-            for (;;) {
-                if (c == '"') break;
-                if (c == '\\') {
-                    next(); // skip '"' after '\\'
-                }
-                next();
-            }
-        } else if (is_eof()) {
-            error("stray eof while parsing macro args");
-        }
-        if (!is_space(c)) {
-            *epos = src->pos; // update *epos every time to detect the last non-delimiter position
+/*
+ * appends the source text of t to buf
+ */
+void append_spelling(char *buf, token *t) {
+    int len = strlen(buf);
+    if (t->id == T_IDENT) {
+        if (len + strlen(t->str_value) >= RCC_BUF_SIZE) {
+            error("too long token by '##'");
         }
-        next();
+        strcat(buf, t->str_value);
+        return;
     }
+    if (len + t->src_end_pos - t->src_pos + 1 >= RCC_BUF_SIZE) {
+        error("too long token by '##'");
+    }
+    char *body = file_info(t->src_id)->body;
+    for (int i=t->src_pos; i<=t->src_end_pos; i++) {
+        buf[len] = body[i];
+        len++;
+    }
+    buf[len] = '\0';
 }
 
-void build_macro_env(macro_t *m) {
-
-    macro_frame_t *frame = macro_frame_vec_extend(macro_frames, 1);
-    frame->m = m;
-    frame->args = macro_vec_new();
-
-    if (m->vars->len > 0) {
-        debug("scanning macro's actual args...");
-        skip();
-        if (ch() != '(') error("macro %s requires actual arguments in (...)", m->name);
-        next();
-
-        // parse args
-        for (int i=0; i<m->vars->len; i++) {
-            int spos, epos;
-            read_macro_arg(&spos, &epos, i==m->vars->len-1);
-
-            // store the macro's actual argument value into macro_t 
-            macro_t *arg = macro_vec_extend(frame->args, 1);
-            arg->name = strdup(*char_p_vec_get(m->vars, i));
-            arg->src = src;
-            arg->start_pos = spos;
-            arg->end_pos = epos;
-            arg->vars = char_p_vec_new();
+/*
+ * replaces the last token in macro_work with the tokens lexed from it and t pasted together
+ */
+void paste_token(token *t) {
+    char buf[RCC_BUF_SIZE];
+    buf[0] = '\0';
+    append_spelling(buf, token_vec_top(ctx->macro_work));
+    append_spelling(buf, t);
+    token_vec_pop(ctx->macro_work);
+    lex_text(arena_strdup(buf), ctx->macro_work);
+}
 
-            debug("scanned args: %s as |%s|" , arg->name, dump_file(src->id, spos, epos));
-            next();
+/*
+ * returns the position after the ')' matching the '(' at in[pos]
+ */
+int macro_args_end(macro_t *m, token_vec in, int pos, int to) {
+    int depth = 0;
+    while (pos < to) {
+        token_id id = token_vec_get(in, pos)->id;
+        pos++;
+        if (id == T_LPAREN) {
+            depth++;
+        } else if (id == T_RPAREN) {
+            depth--;
+            if (depth == 0) {
+                return pos;
+            }
         }
     }
-
-    enter_new_file(m->name, m->src->body, m->start_pos, m->end_pos + 1, 1, 1);
-
-    debug("entering macro: %s", src->filename);
+    error("unterminated args for macro %s", m->name);
+    return to;
 }
 
-void extract_macro(char *buf) {
-    char *p = buf;
-    char *str;
-    while(!is_eof()) {
-        if (ch() == '"') {
-            // copy string literal in source sequence 
-            *p++ = ch();
-            next();
-            while (!is_eof()) {
-                int c = ch();
-                *p++ = c;
-                if (c == '"') {
-                    next();
-                    break;
+/*
+ * expands m into out. for a function-like macro, in[from] is '(' and in[to-1] is the matching ')'.
+ * the arguments are expanded first, substituted into the body together with the '##' pastes,
+ * and the result is rescanned with m disabled.
+ */
+void expand_macro(macro_t *m, token_vec in, int from, int to, token_vec out) {
+    int arg_start[MACRO_MAX_ARGS];
+    int arg_end[MACRO_MAX_ARGS];
+    int exp_start[MACRO_MAX_ARGS];
+    int exp_end[MACRO_MAX_ARGS];
+    int nargs = 0;
+    int mark = token_vec_len(ctx->macro_work);
+    ctx->macro_expansions++;
+    trace_begin("macro", m->name);
+
+    if (m->is_function) {
+        int depth = 0;
+        arg_start[0] = from + 1;
+        for (int i=from+1; i<to-1; i++) {
+            token_id id = token_vec_get(in, i)->id;
+            if (id == T_LPAREN) {
+                depth++;
+            } else if (id == T_RPAREN) {
+                depth--;
+            } else if (id == T_COMMA && depth == 0) {
+                if (nargs >= MACRO_MAX_ARGS - 1) {
+                    error("too many args for macro %s", m->name);
                 }
-                if (c == '\\') {
-                    next(); // skip next char after '\\'
-                    *p++ = ch();
-                }
-                next();
+                arg_end[nargs] = i;
+                nargs++;
+                arg_start[nargs] = i + 1;
             }
-        } else if (tokenize_ident(&str)) {
-            bool done = FALSE;
-            // assert(macro_frames_len > 0);
-            macro_frame_t *frame = macro_frame_vec_top(macro_frames);
-            for (int i=0; i<macro_vec_len(frame->args); i++) {
-                macro_t *arg = macro_vec_get(frame->args, i);
-                if (strcmp(arg->name, str) == 0) {
-                    debug("expanding macro arg: %s as %s", str, dump_file(arg->src->id, arg->start_pos, arg->end_pos));
-                    for (int i=arg->start_pos; i<=arg->end_pos; i++) {
-                        *p++ = arg->src->body[i];
-                    }
-                    done = TRUE;
-                    break;
-                }
+        }
+        arg_end[nargs] = to - 1;
+        nargs++;
+        if (nargs == 1 && m->nparams == 0 && arg_start[0] == arg_end[0]) {
+            nargs = 0;
+        }
+        if (nargs != m->nparams) {
+            error("macro %s requires %d args, but got %d", m->name, m->nparams, nargs);
+        }
+        for (int k=0; k<nargs; k++) {
+            exp_start[k] = token_vec_len(ctx->macro_work);
+            if (needs_expanded_arg(m, k)) {
+                expand_tokens(in, arg_start[k], arg_end[k], ctx->macro_work);
             }
+            exp_end[k] = token_vec_len(ctx->macro_work);
+        }
+    }
 
-            if (!done) {
-                for(int i=0; i<strlen(str); i++) {
-                    *p++ = str[i];
-                }
-                done = TRUE;
-            }
-        } else {
-            // copy source char
-            if (!is_eof()) *p++ = ch();
-            next();
+    // substitute the args into the body
+    int res = token_vec_len(ctx->macro_work);
+    int operand = res;
+    for (int j=0; j<m->body_len; j++) {
+        token t = m->body[j];
+        if (t.id == T_PASTE) {
             continue;
         }
+        // an empty operand leaves nothing to paste with
+        bool pasting = (j > 0 && m->body[j - 1].id == T_PASTE && token_vec_len(ctx->macro_work) > operand);
+        operand = token_vec_len(ctx->macro_work);
+        if (pasting) {
+            operand--; // the left operand is merged into this one
+        }
 
-        // process '##' (string concatination) - if there, stop inserting delimiter
+        if (t.id != T_MACRO_PARAM) {
+            if (pasting) {
+                paste_token(&t);
+            } else {
+                token_vec_push(ctx->macro_work, t);
+            }
+            continue;
+        }
 
-        if (accept_string("##")) {
-            skip();
-        } else {
-            *p++ = ' ';
+        int k = t.int_value;
+        token_vec v = ctx->macro_work;
+        int start = exp_start[k];
+        int end = exp_end[k];
+        if (is_paste_operand(m, j)) {
+            v = in;
+            start = arg_start[k];
+            end = arg_end[k];
         }
+        for (int i=start; i<end; i++) {
+            token a = *token_vec_get(v, i);
+            if (i == start && pasting) {
+                paste_token(&a);
+            } else {
+                token_vec_push(ctx->macro_work, a);
+            }
+        }
+    }
+    int res_end = token_vec_len(ctx->macro_work);
+
+    m->expanding = TRUE;
+    expand_tokens(ctx->macro_work, res, res_end, out);
+    m->expanding = FALSE;
+
+    if (out == ctx->macro_work) {
+        // move the result down over the scratch area
+        int n = token_vec_len(ctx->macro_work) - res_end;
+        for (int i=0; i<n; i++) {
+            token t = *token_vec_get(ctx->macro_work, res_end + i);
+            token_vec_set(ctx->macro_work, mark + i, t);
+        }
+        ctx->macro_work->len = mark + n;
+    } else {
+        ctx->macro_work->len = mark;
     }
-    *p = '\0';
+    trace_end();
 }
 
-bool enter_macro(const char *name) {
-    if (macro_frames == NULL) {
-        macro_frames = macro_frame_vec_new();
+/*
+ * appends in[from..to) to out, expanding the macros in it.
+ * the args of a function-like macro are taken from the same range.
+ */
+void expand_tokens(token_vec in, int from, int to, token_vec out) {
+    int i = from;
+    while (i < to) {
+        token t = *token_vec_get(in, i);
+        i++;
+        macro_t *m = NULL;
+        if (t.id == T_IDENT) {
+            m = find_macro(t.str_value);
+        }
+        if (m && !m->expanding) {
+            if (!m->is_function) {
+                expand_macro(m, in, i, i, out);
+                continue;
+            }
+            if (i < to && token_vec_get(in, i)->id == T_LPAREN) {
+                int end = macro_args_end(m, in, i, to);
+                expand_macro(m, in, i, end, out);
+                i = end;
+                continue;
+            }
+        }
+        token_vec_push(out, t);
     }
+}
 
-    macro_t *m = find_macro(name);
-    if (!m) return FALSE;
-
-    if (is_in_expanding(name)) { // do not expand current macro again
+/*
+ * expands m whose name has just been read from the source; a function-like macro takes its args
+ * from the source too. returns FALSE if a function-like macro is not followed by '('.
+ */
+bool expand_source_macro(macro_t *m, token_vec out) {
+    if (!m->is_function) {
+        expand_macro(m, NULL, 0, 0, out);
+        return TRUE;
+    }
+    int mark = token_vec_len(ctx->macro_work);
+    if (!lex_macro_args(ctx->macro_work)) {
         return FALSE;
     }
-    debug("found macro %s", name);
-    build_macro_env(m);
-
-    char *macro_ext_buf = calloc(RCC_BUF_SIZE, 16);
-    extract_macro(macro_ext_buf);
-    debug("extracted: [%s] (%d)", macro_ext_buf, strlen(macro_ext_buf));
-    exit_macro();
-    macro_ext_buf = realloc(macro_ext_buf, strlen(macro_ext_buf)+1);
-
-    enter_new_file(src->filename, macro_ext_buf, 0, strlen(macro_ext_buf), 1, 1);
-
+    expand_macro(m, ctx->macro_work, mark, token_vec_len(ctx->macro_work), out);
+    ctx->macro_work->len = mark;
     return TRUE;
 }
-
-bool exit_macro() {
-    macro_frame_vec_pop(macro_frames);
-    return exit_file();
-}
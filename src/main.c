@@ -1,24 +1,190 @@
 #include "types.h"
+#include "rsys.h"
 #include "devtool.h"
 #include "rstring.h"
+#include "arena.h"
+#include "vec.h"
+#include "map.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "parse.h"
+#include "server.h"
+#include "stats.h"
+#include "trace.h"
+#include "context.h"
 
-extern int open(const char*, int, int);
-extern int close(int);
 #define O_CREAT 0x40
 #define O_TRUNC 0x200
 #define O_WRONLY 1
 
-extern void tokenize_file(char *);
 extern void add_include_dir(char *);
-extern int parse();
-extern void compile_file(int fd);
 
-int main(int argc, char **argv) {
+int open_output(char *filename) {
+    int fd = open(filename, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd == -1) {
+        error("cannot open output file: %s", filename);
+    }
+    debug("write output to file:%s", filename);
+    return fd;
+}
+
+/*
+ * compiles the source into the output file, or stdout if output_name is NULL.
+ * the output is opened only when the source is parsed, unless each function is emitted as soon
+ * as it is parsed by 'stream'
+ */
+void compile_source(char *filename, char *output_name, bool stream) {
+    trace_source(filename);
+    long start = stats_start();
+    trace_begin("phase", "tokenize_file");
+    tokenize_file(filename);
+    trace_end();
+    stats_phase("tokenize_file", start);
+    int pch_loaded;
+    int pch_written;
+    pch_stats(&pch_loaded, &pch_written);
+    info("pch: %d loaded, %d written", pch_loaded, pch_written);
+
+    int output_fd = 1;
+    if (stream) {
+        if (output_name) {
+            output_fd = open_output(output_name);
+        }
+        start = stats_start();
+        trace_begin("phase", "parse+emit");
+        stream_open(output_fd);
+        parse();
+        stream_close();
+        trace_end();
+        stats_phase("parse+emit", start);
+    } else {
+        start = stats_start();
+        trace_begin("phase", "parse");
+        parse();
+        trace_end();
+        stats_phase("parse", start);
+        if (output_name) {
+            output_fd = open_output(output_name);
+        }
+        start = stats_start();
+        trace_begin("phase", "compile_file");
+        compile_file(output_fd);
+        trace_end();
+        stats_phase("compile_file", start);
+    }
+    if (output_fd != 1) {
+        close(output_fd);
+    }
+
+    info("arena: %ld bytes in %d chunks", arena_allocated(), arena_chunk_count());
+    stats_report(filename);
+    trace_flush();
+    context_free(ctx);
+}
+
+/*
+ * returns dir/name.s for the source path/to/name.c
+ */
+char *output_path(char *dir, char *source) {
+    char *base = source;
+    for (char *p = source; *p; p++) {
+        if (*p == '/') {
+            base = p + 1;
+        }
+    }
+    int len = strlen(base);
+    if (len > 2 && base[len - 2] == '.' && base[len - 1] == 'c') {
+        len = len - 2;
+    }
+    char buf[RCC_BUF_SIZE];
+    if (snprintf(buf, RCC_BUF_SIZE, "%s/%.*s.s", dir, len, base) >= RCC_BUF_SIZE) {
+        error("too long output file name for %s", source);
+    }
+    return arena_strdup(buf);
+}
+
+/*
+ * compiles each source into its own .s in output_dir, by forked processes at most jobs at a time.
+ * every process starts from the same state as a single file compile, so the outputs are the same
+ * whatever jobs is. the output of a failed compile is removed. returns the number of failures.
+ */
+int compile_sources(char **sources, int count, char *output_dir, int jobs, bool stream) {
+    char **outputs = arena_alloc(count * sizeof(char *));
+    int *pids = arena_alloc(count * sizeof(int));
+    for (int i=0; i<count; i++) {
+        outputs[i] = output_path(output_dir, sources[i]);
+        pids[i] = 0;
+    }
+
+    int next = 0;
+    int running = 0;
+    int failed = 0;
+    while (next < count || running > 0) {
+        if (next < count && running < jobs) {
+            int pid = fork();
+            if (pid == -1) {
+                error("cannot fork for %s", sources[next]);
+            }
+            if (pid == 0) {
+                ctx->error_exit = NULL; // a failing process just exits, even in a server
+                compile_source(sources[next], outputs[next], stream);
+                exit(0);
+            }
+            pids[next] = pid;
+            next++;
+            running++;
+            continue;
+        }
+
+        int status;
+        int pid = wait(&status);
+        if (pid == -1) {
+            error("lost the compile processes");
+        }
+        running--;
+        if (status != 0) {
+            failed++;
+            for (int i=0; i<next; i++) {
+                if (pids[i] == pid) {
+                    warning("failed to compile %s", sources[i]);
+                    unlink(outputs[i]);
+                }
+            }
+        }
+    }
+    info("compiled %d files by %d jobs, %d failed", count, jobs, failed);
+    return failed;
+}
+
+/*
+ * compiles as the args (without the program name) tell. returns the exit status
+ */
+int compile_main(int argc, char **argv) {
     int arg_index;
     bool out_asm_source = FALSE;
-    int output_fd = 1;
+    char *output_name = NULL;
+    int jobs = 1;
+    bool stream = FALSE;
+    char *trace_path = NULL;
 
-    for (arg_index = 1;  arg_index < argc; arg_index++) {
+    for (arg_index = 0;  arg_index < argc; arg_index++) {
+        if (strcmp("-vv", argv[arg_index]) == 0) {
+            set_log_level(LOG_DEBUG);
+            continue;
+        }
+        if (strcmp("-v", argv[arg_index]) == 0) {
+            set_log_level(LOG_INFO);
+            continue;
+        }
         if (strncmp("-I", argv[arg_index], 2) == 0) {
             add_include_dir(&argv[arg_index][2]);
             continue;
@@ -27,17 +193,54 @@ int main(int argc, char **argv) {
             out_asm_source = TRUE;
             continue;
         }
-        if (strncmp("-o", argv[arg_index], 2) == 0) {
+        if (strncmp("--stats", argv[arg_index], 7) == 0) {
+            char *format = &argv[arg_index][7];
+            if (*format == '\0' || strcmp("=text", format) == 0) {
+                ctx->stats = STATS_TEXT;
+            } else if (strcmp("=json", format) == 0) {
+                ctx->stats = STATS_JSON;
+            } else {
+                error("unknown format of --stats: %s", argv[arg_index]);
+            }
+            continue;
+        }
+        if (strncmp("--trace=", argv[arg_index], 8) == 0) {
+            trace_path = &argv[arg_index][8];
+            continue;
+        }
+        if (strcmp("--stream", argv[arg_index]) == 0) {
+            stream = TRUE;
+            continue;
+        }
+        if (strcmp("--pch", argv[arg_index]) == 0) {
             arg_index++;
-            if (arg_index < argc) {
-                output_fd = open(argv[arg_index], O_CREAT | O_TRUNC | O_WRONLY, 0644);
-                if (output_fd == -1) {
-                    error("cannot open output file: %s", argv[arg_index]);
+            if (arg_index >= argc) {
+                error("specified --pch option without directory name");
+            }
+            pch_set_dir(argv[arg_index]);
+            continue;
+        }
+        if (strncmp("-j", argv[arg_index], 2) == 0) {
+            char *n = &argv[arg_index][2];
+            if (*n == '\0') {
+                arg_index++;
+                if (arg_index >= argc) {
+                    error("specified -j option without number of jobs");
                 }
-            } else {
+                n = argv[arg_index];
+            }
+            jobs = atoi(n);
+            if (jobs < 1) {
+                error("invalid number of jobs: %s", n);
+            }
+            continue;
+        }
+        if (strncmp("-o", argv[arg_index], 2) == 0) {
+            arg_index++;
+            if (arg_index >= argc) {
                 error("specified -o option without file name");
             }
-            debug("write output to file:%s", argv[arg_index]);
+            output_name = argv[arg_index];
             continue;
         }
         break;
@@ -49,13 +252,119 @@ int main(int argc, char **argv) {
         error("need -S option. This copmiler only outputs asm source.");
     }
 
-    tokenize_file(argv[arg_index]);
+    int trace_fd = 0;
+    if (trace_path) {
+        trace_fd = trace_open(trace_path);
+    }
 
-    parse();
+    // with more than one source, -o names the directory of the .s files
+    int status = 0;
+    int count = argc - arg_index;
+    if (count > 1) {
+        if (!output_name) {
+            output_name = ".";
+        }
+        if (compile_sources(&argv[arg_index], count, output_name, jobs, stream) > 0) {
+            status = 1;
+        }
+    } else {
+        compile_source(argv[arg_index], output_name, stream);
+    }
 
-    compile_file(output_fd);
+    if (trace_fd) {
+        trace_close(trace_fd);
+    }
+    return status;
+}
 
-    if (output_fd != 1) {
-        close(output_fd);
+/*
+ * runs a request of the server in the current context, which is freed at the end.
+ * returns the exit status
+ */
+int serve_compile(int argc, char **argv, context_t *keeper, char *pch_dir) {
+    long env[JMP_BUF_LONGS];
+    if (_setjmp(env)) {
+        if (ctx->outbuf_fd > 2) {
+            close(ctx->outbuf_fd);
+        }
+        if (ctx->trace_fd) {
+            close(ctx->trace_fd);
+        }
+        context_free(ctx);
+        return 1;
+    }
+    ctx->error_exit = env;
+    pch_keep(keeper);
+    if (pch_dir) {
+        pch_set_dir(pch_dir);
+    }
+    int status = compile_main(argc, argv);
+    if (ctx) {
+        context_free(ctx);
+    }
+    return status;
+}
+
+/*
+ * serves the requests of 'rcc --client' one at a time, each compiled in a context of its own.
+ * the precompiled headers loaded stay mapped in the server's context for the later requests,
+ * and an error ends only its request
+ */
+void serve(char *socket_path, char *pch_dir) {
+    if (pch_dir && *pch_dir != '/') {
+        // each request runs in the client's working dir
+        char cwd[RCC_BUF_SIZE];
+        if (!getcwd(cwd, RCC_BUF_SIZE)) {
+            error("cannot get the working dir");
+        }
+        int len = strlen(cwd) + 1 + strlen(pch_dir) + 1;
+        char *path = arena_alloc(len);
+        snprintf(path, len, "%s/%s", cwd, pch_dir);
+        pch_dir = path;
+    }
+    server_t *s = server_listen(socket_path);
+    context_t *keeper = ctx;
+    int level = log_level;
+    info("serving on %s", socket_path);
+    for (;;) {
+        context_use(context_new());
+        char *level_name;
+        int argc;
+        char **argv;
+        if (server_accept(s, &level_name, &argc, &argv)) {
+            init_log_level(level_name);
+            int status = serve_compile(argc, argv, keeper, pch_dir);
+            server_reply(s, status);
+        } else if (ctx) {
+            context_free(ctx);
+        }
+        context_use(keeper);
+        pch_trim(keeper);
+        set_log_level(level);
+    }
+}
+
+int main(int argc, char **argv) {
+    init_log_level(getenv("RCC_LOG_LEVEL"));
+    context_use(context_new());
+
+    if (argc >= 3 && strcmp("--server", argv[1]) == 0) {
+        char *pch_dir = NULL;
+        if (argc == 5 && strcmp("--pch", argv[3]) == 0) {
+            pch_dir = argv[4];
+        } else if (argc != 3) {
+            error("usage: rcc --server <socket> [--pch <dir>]");
+        }
+        serve(argv[2], pch_dir);
+        return 0;
+    }
+    if (argc >= 3 && strcmp("--client", argv[1]) == 0) {
+        int status;
+        if (client_request(argv[2], argc - 3, &argv[3], &status)) {
+            return status;
+        }
+        info("no server at %s, compiling here", argv[2]);
+        return compile_main(argc - 3, &argv[3]);
     }
+    return compile_main(argc - 1, &argv[1]);
 }
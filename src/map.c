@@ -0,0 +1,131 @@
+#include "types.h"
+#include "rsys.h"
+#include "rstring.h"
+#include "arena.h"
+
+#include "map.h"
+
+/*
+ * kept below 2^26 at each step, so that 'h * 31 + c' never overflows an int:
+ * rcc has no unsigned, and gcc builds must hash the same as rcc builds
+ */
+int str_map_hash(const char *key) {
+    int h = 0;
+    for (char *p = (char *)key; *p; p++) {
+        h = (h * 31 + *p) & 0x3ffffff;
+    }
+    return h;
+}
+
+void str_map_alloc(str_map m, int cap) {
+    m->cap = cap;
+    m->len = 0;
+    m->used = 0;
+    m->keys = arena_alloc(cap * sizeof(char *));
+    m->values = arena_alloc(cap * sizeof(void *));
+    m->hashes = arena_alloc(cap * sizeof(int));
+    for (int i=0; i<cap; i++) {
+        m->hashes[i] = STR_MAP_EMPTY;
+    }
+}
+
+str_map str_map_new() {
+    str_map m = arena_alloc(sizeof(*m));
+    str_map_alloc(m, STR_MAP_INITIAL_CAP);
+    return m;
+}
+
+/*
+ * returns the slot of the key, or -1 if not found
+ */
+int str_map_find(str_map m, const char *key, int hash) {
+    int i = hash & (m->cap - 1);
+    for (;;) {
+        int h = m->hashes[i];
+        if (h == STR_MAP_EMPTY) {
+            return -1;
+        }
+        if (h == hash && (m->keys[i] == key || strcmp(m->keys[i], key) == 0)) {
+            return i;
+        }
+        i = (i + 1) & (m->cap - 1);
+    }
+}
+
+void str_map_rehash(str_map m) {
+    char **keys = m->keys;
+    void **values = m->values;
+    int *hashes = m->hashes;
+    int cap = m->cap;
+
+    // grow only when live keys fill up; otherwise just sweep the deleted slots
+    str_map_alloc(m, (m->len * 2 >= cap / 2) ? cap * 2 : cap);
+    for (int i=0; i<cap; i++) {
+        if (hashes[i] >= 0) {
+            int j = hashes[i] & (m->cap - 1);
+            while (m->hashes[j] != STR_MAP_EMPTY) {
+                j = (j + 1) & (m->cap - 1);
+            }
+            m->keys[j] = keys[i];
+            m->values[j] = values[i];
+            m->hashes[j] = hashes[i];
+            m->len++;
+            m->used++;
+        }
+    }
+}
+
+void *str_map_get(str_map m, const char *key) {
+    int i = str_map_find(m, key, str_map_hash(key));
+    if (i < 0) {
+        return NULL;
+    }
+    return m->values[i];
+}
+
+void str_map_put(str_map m, const char *key, void *value) {
+    int hash = str_map_hash(key);
+    int i = str_map_find(m, key, hash);
+    if (i >= 0) {
+        m->values[i] = value;
+        return;
+    }
+
+    if ((m->used + 1) * 4 > m->cap * 3) {
+        str_map_rehash(m);
+    }
+    i = hash & (m->cap - 1);
+    while (m->hashes[i] >= 0) {
+        i = (i + 1) & (m->cap - 1);
+    }
+    if (m->hashes[i] == STR_MAP_EMPTY) {
+        m->used++;
+    }
+    m->keys[i] = (char *)key;
+    m->values[i] = value;
+    m->hashes[i] = hash;
+    m->len++;
+}
+
+bool str_map_delete(str_map m, const char *key) {
+    int i = str_map_find(m, key, str_map_hash(key));
+    if (i < 0) {
+        return FALSE;
+    }
+    m->keys[i] = NULL;
+    m->values[i] = NULL;
+    m->hashes[i] = STR_MAP_DELETED;
+    m->len--;
+    return TRUE;
+}
+
+char *str_map_next(str_map m, int *iter) {
+    while (*iter < m->cap) {
+        int i = *iter;
+        *iter = i + 1;
+        if (m->hashes[i] >= 0) {
+            return m->keys[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,103 @@
+#include "types.h"
+#include "rsys.h"
+#include "arena.h"
+#include "rstring.h"
+#include "devtool.h"
+#include "vec.h"
+#include "map.h"
+
+#include "outbuf.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
+void outbuf_open(int fd) {
+    ctx->outbuf_fd = fd;
+    ctx->outbuf_len = 0;
+    ctx->outbuf_writes = 0;
+    if (!ctx->outbuf_body) {
+        ctx->outbuf_cap = OUTBUF_CHUNK_SIZE;
+        ctx->outbuf_body = arena_alloc(ctx->outbuf_cap);
+    }
+}
+
+void outbuf_flush() {
+    if (ctx->outbuf_fd == -1) {
+        return; // kept in memory
+    }
+    int pos = 0;
+    while (pos < ctx->outbuf_len) {
+        int n = write(ctx->outbuf_fd, ctx->outbuf_body + pos, ctx->outbuf_len - pos);
+        ctx->outbuf_writes++;
+        if (n <= 0) {
+            error("cannot write output to fd:%d", ctx->outbuf_fd);
+        }
+        pos += n;
+    }
+    ctx->outbuf_len = 0;
+}
+
+/*
+ * makes room for 'size' more bytes, flushing the current chunk if needed, or growing it in memory
+ */
+void outbuf_reserve(int size) {
+    if (ctx->outbuf_len + size <= ctx->outbuf_cap) {
+        return;
+    }
+    if (ctx->outbuf_fd == -1) {
+        int cap = max(ctx->outbuf_cap * 2, ctx->outbuf_len + size);
+        ctx->outbuf_body = arena_realloc(ctx->outbuf_body, ctx->outbuf_cap, cap);
+        ctx->outbuf_cap = cap;
+        return;
+    }
+    outbuf_flush();
+    if (size > ctx->outbuf_cap) {
+        ctx->outbuf_cap = size;
+        ctx->outbuf_body = arena_alloc(ctx->outbuf_cap); // empty after the flush
+    }
+}
+
+void outbuf_write(char *s, int len) {
+    outbuf_reserve(len);
+    char *d = ctx->outbuf_body + ctx->outbuf_len;
+    for (int i=0; i<len; i++) {
+        *d++ = *s++;
+    }
+    ctx->outbuf_len += len;
+}
+
+/*
+ * formats into the buffer. returns FALSE when the result did not fit;
+ * then the room is already made and the caller should va_start() again and retry.
+ */
+bool outbuf_vprintf(char *fmt, va_list va) {
+    int room = ctx->outbuf_cap - ctx->outbuf_len;
+    int len = vsnprintf(ctx->outbuf_body + ctx->outbuf_len, room, fmt, va);
+    if (len < room) {
+        ctx->outbuf_len += len;
+        return TRUE;
+    }
+    outbuf_reserve(len + 1);
+    return FALSE;
+}
+
+int outbuf_write_count() {
+    return ctx->outbuf_writes;
+}
+
+/*
+ * returns what has been written in memory, in the arena
+ */
+char *outbuf_contents(int *len) {
+    *len = ctx->outbuf_len;
+    return ctx->outbuf_body;
+}
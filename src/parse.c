@@ -3,13 +3,20 @@
 #include "rstring.h"
 #include "devtool.h"
 #include "vec.h"
+#include "map.h"
 
-#include "type.h"
 #include "token.h"
+#include "file.h"
+#include "type.h"
 #include "var.h"
 #include "func.h"
 #include "atom.h"
 #include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
 
 int parse_expr();
 int parse_expr_sequence();
@@ -38,7 +45,7 @@ int parse_string() {
     char *s;
     if (expect_string(&s)) {
         int index = add_global_string(s);
-        return alloc_typed_int_atom(TYPE_STRING, index, type_char_ptr);
+        return alloc_typed_int_atom(TYPE_STRING, index, ctx->type_char_ptr);
     }
     return 0;
 }
@@ -46,15 +53,15 @@ int parse_string() {
 int parse_int_literal() {
     int v=0;
     if(expect_int(&v) || expect_enum_member(&v)) {
-        return alloc_typed_int_atom(TYPE_INTEGER, v, type_int);
+        return alloc_typed_int_atom(TYPE_INTEGER, v, ctx->type_int);
     }
     char ch=0;
     if (expect_char(&ch)) {
-        return alloc_typed_int_atom(TYPE_INTEGER, (int)ch, type_char);
+        return alloc_typed_int_atom(TYPE_INTEGER, (int)ch, ctx->type_char);
     }
     long l=0;
     if (expect_long(&l)) {
-        return alloc_typed_long_atom(TYPE_INTEGER, l, type_long);
+        return alloc_typed_long_atom(TYPE_INTEGER, l, ctx->type_long);
     }
 
     return 0;
@@ -86,7 +93,7 @@ int parse_var() {
     var_t *v = parse_var_name();
     if (v) {
         if (v->is_constant) {
-            return alloc_typed_int_atom(TYPE_INTEGER, v->int_value, type_int);
+            return alloc_typed_int_atom(TYPE_INTEGER, v->int_value, ctx->type_int);
         } else {
             return alloc_var_atom(v);
         }
@@ -100,11 +107,11 @@ int _alloc_bind_into_var_offset(int offset, int rval_pos, type_t *t) {
 }
 
 int _alloc_int_atom(int val) {
-    return alloc_typed_int_atom(TYPE_INTEGER, val, type_int);
+    return alloc_typed_int_atom(TYPE_INTEGER, val, ctx->type_int);
 }
 
 int _alloc_andthen(int cur, int next) {
-    return alloc_binop_atom(TYPE_ANDTHEN, alloc_typed_pos_atom(TYPE_EXPR_STATEMENT, cur, type_void), next);
+    return alloc_binop_atom(TYPE_ANDTHEN, alloc_typed_pos_atom(TYPE_EXPR_STATEMENT, cur, ctx->type_void), next);
 }
 
 int parse_primary() {
@@ -203,7 +210,7 @@ int parse_struct_member(int pos) {
     if (!expect_ident(&name)) {
         error("invalid member name");
     }
-    type_t *t = program[pos].t->ptr_to;
+    type_t *t = atom_at(pos)->t->ptr_to;
     member_t *m = find_struct_member(t, name);
     if (!m) {
         error("this type doesn't has member: %s", name);
@@ -261,10 +268,9 @@ int parse_prefix_incdec() {
     if (!pos) {
         error("Invalid expr after '++'|'--'");
     }
-    return alloc_assign_op_atom(op_type, pos, alloc_typed_int_atom(TYPE_INTEGER, 1, type_int));
+    return alloc_assign_op_atom(op_type, pos, alloc_typed_int_atom(TYPE_INTEGER, 1, ctx->type_int));
 }
 
-
 int parse_ptr_deref() {
     int pos;
     if (!expect(T_ASTERISK)) {
@@ -303,7 +309,7 @@ int parse_signed() {
         if (!pos) {
             error("Invalid '-'");
         }
-        return alloc_binop_atom(TYPE_SUB, alloc_typed_int_atom(TYPE_INTEGER, 0, type_int), atom_to_rvalue(pos));
+        return alloc_binop_atom(TYPE_SUB, alloc_typed_int_atom(TYPE_INTEGER, 0, ctx->type_int), atom_to_rvalue(pos));
     }
     return 0;
 }
@@ -315,10 +321,10 @@ int parse_sizeof() {
 
     int pos = parse_unary();
     if (pos) {
-        if (program[pos].t->array_length < 0) {
+        if (atom_at(pos)->t->array_length < 0) {
             pos = atom_to_rvalue(pos);
         }
-        return alloc_typed_int_atom(TYPE_INTEGER, type_size(program[pos].t), type_int);
+        return alloc_typed_int_atom(TYPE_INTEGER, type_size(atom_at(pos)->t), ctx->type_int);
     }
 
     if (!expect(T_LPAREN)) {
@@ -332,7 +338,7 @@ int parse_sizeof() {
     if (!expect(T_RPAREN)) {
         error("no closing  after sizeof(type");
     }
-    return alloc_typed_int_atom(TYPE_INTEGER, type_size(t), type_int);
+    return alloc_typed_int_atom(TYPE_INTEGER, type_size(t), ctx->type_int);
 }
 
 int parse_bitwise_not() {
@@ -343,10 +349,10 @@ int parse_bitwise_not() {
             error("Invalid '~'");
         }
         pos = atom_to_rvalue(pos);
-        if (program[pos].type == TYPE_INTEGER) {
-            return alloc_typed_int_atom(TYPE_INTEGER, ~(program[pos].int_value), type_int);
+        if (atom_at(pos)->type == TYPE_INTEGER) {
+            return alloc_typed_int_atom(TYPE_INTEGER, ~(atom_at(pos)->int_value), ctx->type_int);
         }
-        return alloc_typed_pos_atom(TYPE_NEG, atom_to_rvalue(pos), type_int);
+        return alloc_typed_pos_atom(TYPE_NEG, atom_to_rvalue(pos), ctx->type_int);
     }
     return 0;
 }
@@ -362,10 +368,10 @@ int parse_logical_not() {
         error("Invalid '!'");
     }
     pos = atom_to_rvalue(pos);
-    if (program[pos].type == TYPE_INTEGER) {
-        return alloc_typed_int_atom(TYPE_INTEGER, !(program[pos].int_value), type_int);
+    if (atom_at(pos)->type == TYPE_INTEGER) {
+        return alloc_typed_int_atom(TYPE_INTEGER, !(atom_at(pos)->int_value), ctx->type_int);
     }
-    return alloc_typed_pos_atom(TYPE_LOG_NOT, pos, type_int);
+    return alloc_typed_pos_atom(TYPE_LOG_NOT, pos, ctx->type_int);
 }
 
 int parse_cast() {
@@ -721,13 +727,15 @@ int parse_ternary(int eq_pos) {
             error("nosecond value for ternary operator");
         }
         int first = atom_to_rvalue(val1);
-        type_t *first_t = program[first].t;
+        type_t *first_t = atom_at(first)->t;
         int second = atom_to_rvalue(val2);
-        type_t *second_t = program[second].t;
 
-        int pos = alloc_typed_pos_atom(TYPE_TERNARY, atom_to_rvalue(eq_pos), first_t);
-        alloc_typed_pos_atom(TYPE_ARG, first, first_t);
-        alloc_typed_pos_atom(TYPE_ARG, second, second_t);
+        int cond = atom_to_rvalue(eq_pos);
+        int pos = alloc_atom(3);
+        build_pos_atom(pos, TYPE_TERNARY, cond);
+        atom_at(pos)->t = first_t;
+        build_pos_atom(pos+1, TYPE_ARG, first);
+        build_pos_atom(pos+2, TYPE_ARG, second);
         return pos;
     }
     return 0;
@@ -782,7 +790,7 @@ int parse_expr_statement() {
 
     pos = parse_expr_sequence();
     if (pos != 0 && expect(T_SEMICOLON)) {
-        return alloc_typed_pos_atom(TYPE_EXPR_STATEMENT, pos, type_void);
+        return alloc_typed_pos_atom(TYPE_EXPR_STATEMENT, pos, ctx->type_void);
     }
     return 0;
 }
@@ -853,7 +861,7 @@ int parse_default_clause() {
         if (!expect(T_COLON)) {
             error("colon ':' is needed after 'default'");
         }
-        return alloc_typed_pos_atom(TYPE_DEFAULT, parse_block_or_statement_series(), type_void);
+        return alloc_typed_pos_atom(TYPE_DEFAULT, parse_block_or_statement_series(), ctx->type_void);
     }
     return 0;
 }
@@ -895,11 +903,21 @@ int parse_switch_statement() {
     if (!expect(T_RBLACE)) {
         error("invalid end of 'switch' body");
     }
-    int pos2 = alloc_atom(n + 1);
-    build_pos_atom(pos2, TYPE_SWITCH, atom_to_rvalue(pos));
+    pos = atom_to_rvalue(pos);
+    for (int i=1; i<=n; i++) {
+        int case_pos = body_pos[i];
+        if (atom_at(case_pos)->type == TYPE_CASE) {
+            // compare case values in the type of the switch target (e.g. char literals against int)
+            int value_pos = atom_convert_type(pos, atom_at(case_pos)->atom_pos);
+            atom_at(case_pos)->atom_pos = value_pos;
+        }
+    }
+    int pos2 = alloc_atom(n + 2);
+    build_pos_atom(pos2, TYPE_SWITCH, pos);
     for (int i=1; i<=n; i++) {
         build_pos_atom(pos2+i, TYPE_ARG, body_pos[i]);
     }
+    build_int_atom(pos2+n+1, TYPE_NOP, 0); // terminates the list of clauses
     return pos2;
 }
 
@@ -907,7 +925,7 @@ int wrap_expr_sequence(int pos) {
     if (!pos) {
         return alloc_nop_atom();
     } else {
-        return  alloc_typed_pos_atom(TYPE_EXPR_STATEMENT, atom_to_rvalue(pos), type_void);
+        return  alloc_typed_pos_atom(TYPE_EXPR_STATEMENT, atom_to_rvalue(pos), ctx->type_void);
     }
 }
 
@@ -939,7 +957,7 @@ int parse_for_statement() {
     }
     cond_pos = parse_expr_sequence();
     if (!cond_pos) {
-        cond_pos = alloc_typed_int_atom(TYPE_INTEGER, 1, type_int); // TRUE
+        cond_pos = alloc_typed_int_atom(TYPE_INTEGER, 1, ctx->type_int); // TRUE
     }   
     if (!expect(T_SEMICOLON)) {
         error("invalid end of the second part of 'for' conditions");
@@ -1015,7 +1033,7 @@ int parse_do_while_statement() {
 int parse_break_statement() {
     if (expect(T_BREAK)) {
         if (expect(T_SEMICOLON)) {
-            return alloc_typed_pos_atom(TYPE_BREAK, 0, type_void);
+            return alloc_typed_pos_atom(TYPE_BREAK, 0, ctx->type_void);
         }
     }
     return 0;
@@ -1024,7 +1042,7 @@ int parse_break_statement() {
 int parse_continue_statement() {
     if (expect(T_CONTINUE)) {
         if (expect(T_SEMICOLON)) {
-            return alloc_typed_pos_atom(TYPE_CONTINUE, 0, type_void);
+            return alloc_typed_pos_atom(TYPE_CONTINUE, 0, ctx->type_void);
         }
     }
     return 0;
@@ -1044,7 +1062,7 @@ int parse_return_statement() {
     if (!expect(T_SEMICOLON)) {
         error("invalid expr for return");
     }
-    return alloc_typed_pos_atom(TYPE_RETURN, pos, (pos == 0) ? type_void : program[pos].t);
+    return alloc_typed_pos_atom(TYPE_RETURN, pos, (pos == 0) ? ctx->type_void : atom_at(pos)->t);
 }
 
 int parse_statement() {
@@ -1082,11 +1100,9 @@ int parse_statement() {
     return pos;
 }
 
-
 type_t *parse_type_declaration();
 type_t *parse_pointer(type_t *);
 
-
 type_t *parse_primitive_type() {
     type_t *t;
     char *type_name;
@@ -1115,8 +1131,8 @@ type_t *parse_var_array_declare(type_t *t) {
     int length;
     if (length_pos == 0) {
         length = 0;
-    } else if (program[length_pos].type == TYPE_INTEGER) {
-        length = program[length_pos].int_value;
+    } else if (atom_at(length_pos)->type == TYPE_INTEGER) {
+        length = atom_at(length_pos)->int_value;
     } else {
         error("array length is not contant");
     }
@@ -1170,7 +1186,6 @@ type_t *parse_enum_type() {
     return t;
 }
 
-
 int parse_struct_member_declare(type_t *st) {
     char *ident;
 
@@ -1206,7 +1221,6 @@ int parse_struct_member_declare(type_t *st) {
     return 1;
 }
 
-
 type_t *parse_union_or_struct_type() {
     bool is_union;
     if (expect(T_STRUCT)) {
@@ -1352,8 +1366,8 @@ int parse_global_var_initializer() {
     }
 
     int num_pos = parse_expr();
-    if (num_pos && program[num_pos].type == TYPE_INTEGER) {
-        return program[num_pos].int_value;
+    if (num_pos && atom_at(num_pos)->type == TYPE_INTEGER) {
+        return atom_at(num_pos)->int_value;
     }
 
     error("invalid initializer for global variable");
@@ -1391,7 +1405,6 @@ int parse_global_var_array_initializer(var_t *v, int array_length) {
     return pos;
 }
 
-
 int parse_global_variable(type_t *t, bool is_external) {
     int pos = get_token_pos();
     t = parse_pointer(t);
@@ -1430,7 +1443,7 @@ int parse_array_initializer(var_t *v, int array, int array_length) {
 
     for (index = 0; array_length == 0 || index < array_length; index++) {
         debug("parsing array initializer at index:%d", index);
-        int lval = alloc_index_atom(array, alloc_typed_int_atom(TYPE_INTEGER, index, type_int));
+        int lval = alloc_index_atom(array, alloc_typed_int_atom(TYPE_INTEGER, index, ctx->type_int));
         int assign = parse_variable_initializer(lval);
         if (assign) {
             if (!pos) {
@@ -1458,20 +1471,20 @@ int parse_array_initializer(var_t *v, int array, int array_length) {
         int new_offset = v->offset;
 
         // hacky - traversing AST to update offset of base array variable
-        atom_t *a = &program[pos];
+        atom_t *a = atom_at(pos);
         while (a) {
             atom_t *bind_atom;
             if (a->type == TYPE_ANDTHEN) {
-                bind_atom = &program[(a+1)->int_value];
-                a = &program[(a)->int_value];
+                bind_atom = atom_at((a+1)->int_value);
+                a = atom_at((a)->int_value);
             } else {
                 bind_atom = a;
                 a = (void *)0; // exit loop
             }
             if (bind_atom->type == TYPE_BIND) {
-                atom_t *array_index_atom = &program[(bind_atom+1)->int_value];
+                atom_t *array_index_atom = atom_at((bind_atom+1)->int_value);
                 if (array_index_atom->type == TYPE_ARRAY_INDEX) {
-                    atom_t *var_ref_atom = &program[(array_index_atom)->int_value];
+                    atom_t *var_ref_atom = atom_at((array_index_atom)->int_value);
                     if (var_ref_atom->type == TYPE_VAR_REF && var_ref_atom->int_value == old_offset) {
                         var_ref_atom->int_value = new_offset;
                         var_ref_atom->t = t;
@@ -1675,6 +1688,7 @@ bool parse_func_args() {
 
 int parse_function_definition(type_t *t) {
     int pos = get_token_pos();
+    int mark = atom_mark();
 
     t = parse_pointer(t);
 
@@ -1714,6 +1728,9 @@ int parse_function_definition(type_t *t) {
     func_set_body(f, var_vec_len(frame->vars), frame->vars, body_pos, var_max_offset());
 
     exit_var_frame();
+    if (ctx->streaming) {
+        stream_function(f, mark);
+    }
     return 1;
 }
 
@@ -1759,4 +1776,5 @@ void parse() {
         error("Invalid declaration");
     }
     //exit_var_frame();
+    info("atoms:%d chunks:%d", atom_count(), atom_chunk_count());
 }
@@ -0,0 +1,707 @@
+#include "types.h"
+#include "rsys.h"
+#include "arena.h"
+#include "devtool.h"
+#include "rstring.h"
+#include "vec.h"
+#include "map.h"
+#include "intern.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
+
+#define O_CREAT 0x40
+#define O_TRUNC 0x200
+#define O_WRONLY 1
+
+VEC_INLINE_BODY(pch_file_t, pch_file_vec)
+VEC_INLINE_BODY(pch_dep_t, pch_dep_vec)
+VEC_INLINE_BODY(pch_op_t, pch_op_vec)
+VEC_INLINE_BODY(pch_guard_t, pch_guard_vec)
+VEC_INLINE_BODY(pch_once_t, pch_once_vec)
+VEC_INLINE_BODY(pch_frame_t, pch_frame_vec)
+
+void pch_set_dir(char *dir) {
+    ctx->pch_dir = dir;
+    mkdir(dir, 0755); // may exist already
+    ctx->pch_frames = pch_frame_vec_new();
+}
+
+void pch_stats(int *loaded, int *written) {
+    *loaded = ctx->pch_loaded;
+    *written = ctx->pch_written;
+}
+
+void pch_keep(void *keeper) {
+    ctx->pch_keeper = keeper;
+}
+
+void pch_trim(void *keeper) {
+    context_t *c = context_use(keeper);
+    if (ctx->pch_retired) {
+        for (int i=0; i<vec_len(ctx->pch_retired); i++) {
+            unmap_file(*vec_get(ctx->pch_retired, i));
+        }
+        ctx->pch_retired->len = 0;
+    }
+    context_use(c);
+}
+
+/*
+ * the cache of a file is only valid for the same include dirs
+ */
+char *pch_key(char *path) {
+    char buf[RCC_BUF_SIZE];
+    buf[0] = '\0';
+    strcat(buf, path);
+    for (int i=0; i<char_p_vec_len(ctx->include_dirs); i++) {
+        char *dir = *char_p_vec_get(ctx->include_dirs, i);
+        if (strlen(buf) + strlen(dir) + 2 >= RCC_BUF_SIZE) {
+            error("too long include dirs for pch");
+        }
+        strcat(buf, "\n");
+        strcat(buf, dir);
+    }
+    return arena_strdup(buf);
+}
+
+void pch_file_name(char *buf, char *key) {
+    snprintf(buf, RCC_BUF_SIZE, "%s/%lx.pch", ctx->pch_dir, hash_bytes(key, strlen(key)));
+}
+
+/*
+ * recording
+ */
+
+void pch_begin(char *path, int depth) {
+    pch_frame_t *f = pch_frame_vec_extend(ctx->pch_frames, 1);
+    f->path = path;
+    f->token_start = token_vec_len(ctx->tokens);
+    f->depth = depth;
+    f->touched = str_map_new();
+    f->files = pch_file_vec_new();
+    f->deps = pch_dep_vec_new();
+    f->onces = pch_once_vec_new();
+    f->ops = pch_op_vec_new();
+    f->guards = pch_guard_vec_new();
+    ctx->pch_recording++;
+}
+
+void pch_touch(pch_frame_t *f, char *name) {
+    if (!str_map_get(f->touched, name)) {
+        str_map_put(f->touched, name, name);
+    }
+}
+
+void pch_note_lookup(const char *name, macro_t *m) {
+    for (int i=0; i<ctx->pch_recording; i++) {
+        pch_frame_t *f = pch_frame_vec_get(ctx->pch_frames, i);
+        if (str_map_get(f->touched, name)) {
+            continue;
+        }
+        char *s = intern(name);
+        str_map_put(f->touched, s, s);
+        pch_dep_t *d = pch_dep_vec_extend(f->deps, 1);
+        d->name = s;
+        if (m) {
+            d->hash = m->hash;
+        }
+    }
+}
+
+void pch_note_define(macro_t *m) {
+    for (int i=0; i<ctx->pch_recording; i++) {
+        pch_frame_t *f = pch_frame_vec_get(ctx->pch_frames, i);
+        pch_touch(f, m->name);
+        pch_op_t *op = pch_op_vec_extend(f->ops, 1);
+        op->name = m->name;
+        op->m = m;
+    }
+}
+
+void pch_note_undef(const char *name) {
+    char *s = intern(name);
+    for (int i=0; i<ctx->pch_recording; i++) {
+        pch_frame_t *f = pch_frame_vec_get(ctx->pch_frames, i);
+        pch_touch(f, s);
+        pch_op_t *op = pch_op_vec_extend(f->ops, 1);
+        op->name = s;
+    }
+}
+
+void pch_note_file(char *path, long size, long mtime, long hash) {
+    for (int i=0; i<ctx->pch_recording; i++) {
+        pch_file_t *file = pch_file_vec_extend(pch_frame_vec_get(ctx->pch_frames, i)->files, 1);
+        file->path = path;
+        file->size = size;
+        file->mtime = mtime;
+        file->hash = hash;
+    }
+}
+
+void pch_note_guard(char *path, char *guard) {
+    for (int i=0; i<ctx->pch_recording; i++) {
+        pch_guard_t *g = pch_guard_vec_extend(pch_frame_vec_get(ctx->pch_frames, i)->guards, 1);
+        g->path = path;
+        g->guard = guard;
+    }
+}
+
+/*
+ * a '#pragma once' file included or skipped while recording: the cache depends on whether it was
+ * included already, unless the file being recorded included it itself before
+ */
+void pch_note_once(char *path, bool included) {
+    for (int i=0; i<ctx->pch_recording; i++) {
+        pch_frame_t *f = pch_frame_vec_get(ctx->pch_frames, i);
+        bool found = FALSE;
+        for (int j=0; j<pch_once_vec_len(f->onces) && !found; j++) {
+            if (strcmp(pch_once_vec_get(f->onces, j)->path, path) == 0) {
+                found = TRUE;
+            }
+        }
+        for (int j=0; j<pch_guard_vec_len(f->guards) && !found && included; j++) {
+            pch_guard_t *g = pch_guard_vec_get(f->guards, j);
+            if (strcmp(g->path, path) == 0 && *g->guard == '\0') {
+                found = TRUE;
+            }
+        }
+        if (!found) {
+            pch_once_t *once = pch_once_vec_extend(f->onces, 1);
+            once->path = arena_strdup(path); // may be in a cache unmapped later
+            once->included = included;
+        }
+    }
+}
+
+/*
+ * writing
+ */
+
+void pch_put_byte(int c) {
+    if (ctx->pch_len == ctx->pch_cap) {
+        ctx->pch_buf = arena_realloc(ctx->pch_buf, ctx->pch_cap, ctx->pch_cap * 2);
+        ctx->pch_cap = ctx->pch_cap * 2;
+    }
+    ctx->pch_buf[ctx->pch_len] = c;
+    ctx->pch_len++;
+}
+
+void pch_put_long(long v) {
+    for (int i=0; i<8; i++) {
+        pch_put_byte(v & 255);
+        v = v >> 8;
+    }
+}
+
+void pch_put_int(int v) {
+    for (int i=0; i<4; i++) {
+        pch_put_byte(v & 255);
+        v = v >> 8;
+    }
+}
+
+void pch_put_str(char *s, int len) {
+    pch_put_int(len);
+    for (int i=0; i<len; i++) {
+        pch_put_byte(s[i]);
+    }
+    pch_put_byte(0);
+}
+
+void pch_collect_token(token *t) {
+    if (t->id == T_IDENT || t->id == T_STRING) {
+        if (!str_map_get(ctx->pch_strings, t->str_value)) {
+            char_p_vec_push(ctx->pch_string_list, t->str_value);
+            str_map_put(ctx->pch_strings, t->str_value, (void *)(long)char_p_vec_len(ctx->pch_string_list));
+        }
+    }
+    int id = t->src_id;
+    if (ctx->pch_src_index[id] < 0) {
+        ctx->pch_src_index[id] = int_vec_len(ctx->pch_src_list);
+        int_vec_push(ctx->pch_src_list, id);
+    }
+}
+
+void pch_put_token(token *t) {
+    pch_put_int(t->id);
+    long v = 0; // widened here: an int argument is not sign-extended to a long parameter
+    if (t->id == T_IDENT || t->id == T_STRING) {
+        v = (long)str_map_get(ctx->pch_strings, t->str_value) - 1;
+    } else if (t->id == T_UINT64) {
+        v = t->long_value;
+    } else if (t->id == T_CHAR) {
+        v = t->char_value;
+    } else if (t->id == T_UINT32 || t->id == T_MACRO_PARAM) {
+        v = t->int_value;
+    }
+    pch_put_long(v);
+    int id = t->src_id;
+    pch_put_int(ctx->pch_src_index[id]);
+    pch_put_int(t->src_line);
+    pch_put_int(t->src_column);
+    pch_put_int(t->src_pos);
+    pch_put_int(t->src_end_pos);
+}
+
+void pch_write(pch_frame_t *f) {
+    int ntokens = token_vec_len(ctx->tokens) - f->token_start;
+    int nsrcs = src_count();
+
+    ctx->pch_strings = str_map_new();
+    ctx->pch_string_list = char_p_vec_new();
+    ctx->pch_src_list = int_vec_new();
+    ctx->pch_src_index = arena_alloc(nsrcs * sizeof(int));
+    for (int i=0; i<nsrcs; i++) {
+        ctx->pch_src_index[i] = -1;
+    }
+    for (int i=0; i<pch_op_vec_len(f->ops); i++) {
+        macro_t *m = pch_op_vec_get(f->ops, i)->m;
+        if (m) {
+            for (int j=0; j<m->body_len; j++) {
+                pch_collect_token(&m->body[j]);
+            }
+        }
+    }
+    for (int i=0; i<ntokens; i++) {
+        pch_collect_token(token_vec_get(ctx->tokens, f->token_start + i));
+    }
+
+    if (!ctx->pch_buf) {
+        ctx->pch_cap = 64 * 1024;
+        ctx->pch_buf = arena_alloc(ctx->pch_cap);
+    }
+    ctx->pch_len = 0;
+    pch_put_str(PCH_MAGIC, strlen(PCH_MAGIC));
+    pch_put_int(0); // total length, filled at the end
+    char *key = pch_key(f->path);
+    pch_put_str(key, strlen(key));
+
+    pch_put_int(pch_file_vec_len(f->files));
+    for (int i=0; i<pch_file_vec_len(f->files); i++) {
+        pch_file_t *file = pch_file_vec_get(f->files, i);
+        pch_put_str(file->path, strlen(file->path));
+        pch_put_long(file->size);
+        pch_put_long(file->mtime);
+        pch_put_long(file->hash);
+    }
+
+    pch_put_int(pch_dep_vec_len(f->deps));
+    for (int i=0; i<pch_dep_vec_len(f->deps); i++) {
+        pch_dep_t *d = pch_dep_vec_get(f->deps, i);
+        pch_put_str(d->name, strlen(d->name));
+        pch_put_long(d->hash);
+    }
+
+    pch_put_int(pch_once_vec_len(f->onces));
+    for (int i=0; i<pch_once_vec_len(f->onces); i++) {
+        pch_once_t *once = pch_once_vec_get(f->onces, i);
+        pch_put_str(once->path, strlen(once->path));
+        pch_put_int(once->included);
+    }
+
+    pch_put_int(char_p_vec_len(ctx->pch_string_list));
+    for (int i=0; i<char_p_vec_len(ctx->pch_string_list); i++) {
+        char *s = *char_p_vec_get(ctx->pch_string_list, i);
+        pch_put_str(s, strlen(s));
+    }
+
+    pch_put_int(int_vec_len(ctx->pch_src_list));
+    for (int i=0; i<int_vec_len(ctx->pch_src_list); i++) {
+        src_t *s = file_info(*int_vec_get(ctx->pch_src_list, i));
+        pch_put_str(s->filename, strlen(s->filename));
+        if (s->path) {
+            pch_put_str(s->path, strlen(s->path));
+        } else {
+            pch_put_str("", 0);
+        }
+        pch_put_str(s->body, s->len);
+    }
+
+    pch_put_int(pch_op_vec_len(f->ops));
+    for (int i=0; i<pch_op_vec_len(f->ops); i++) {
+        pch_op_t *op = pch_op_vec_get(f->ops, i);
+        pch_put_str(op->name, strlen(op->name));
+        macro_t *m = op->m;
+        if (!m) {
+            pch_put_int(-1);
+            continue;
+        }
+        pch_put_int(m->body_len);
+        pch_put_int(m->is_function);
+        pch_put_int(m->nparams);
+        for (int j=0; j<m->body_len; j++) {
+            pch_put_token(&m->body[j]);
+        }
+    }
+
+    pch_put_int(ntokens);
+    for (int i=0; i<ntokens; i++) {
+        pch_put_token(token_vec_get(ctx->tokens, f->token_start + i));
+    }
+
+    pch_put_int(pch_guard_vec_len(f->guards));
+    for (int i=0; i<pch_guard_vec_len(f->guards); i++) {
+        pch_guard_t *g = pch_guard_vec_get(f->guards, i);
+        pch_put_str(g->path, strlen(g->path));
+        pch_put_str(g->guard, strlen(g->guard));
+    }
+
+    int total = ctx->pch_len;
+    ctx->pch_len = strlen(PCH_MAGIC) + 5;
+    pch_put_int(total);
+    ctx->pch_len = total;
+
+    // write to a temporary file and rename it, so that a concurrent compile never reads a partial cache
+    char name[RCC_BUF_SIZE];
+    char tmp[RCC_BUF_SIZE];
+    pch_file_name(name, key);
+    snprintf(tmp, RCC_BUF_SIZE, "%s.%d", name, getpid());
+    int fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        warning("cannot write pch: %s", tmp);
+        return;
+    }
+    int pos = 0;
+    while (pos < ctx->pch_len) {
+        int n = write(fd, ctx->pch_buf + pos, ctx->pch_len - pos);
+        if (n <= 0) {
+            break;
+        }
+        pos += n;
+    }
+    close(fd);
+    if (pos < ctx->pch_len || rename(tmp, name) != 0) {
+        warning("cannot write pch: %s", name);
+        return;
+    }
+    ctx->pch_written++;
+    debug("wrote pch of %s: %d tokens, %d bytes", f->path, ntokens, ctx->pch_len);
+}
+
+void pch_end(int depth) {
+    ctx->pch_recording--;
+    pch_frame_t *f = pch_frame_vec_pop(ctx->pch_frames);
+    if (f->depth != depth) {
+        debug("no pch for %s: unbalanced #ifdef", f->path);
+        return;
+    }
+    pch_write(f);
+}
+
+/*
+ * loading
+ */
+
+int pch_get_byte() {
+    if (ctx->pch_in_pos >= ctx->pch_in_len) {
+        ctx->pch_in_broken = TRUE;
+        return 0;
+    }
+    int c = ctx->pch_in[ctx->pch_in_pos];
+    ctx->pch_in_pos++;
+    return c & 255;
+}
+
+long pch_get_long() {
+    long v = 0;
+    for (int i=0; i<8; i++) {
+        long c = pch_get_byte();
+        v = v | (c << (i * 8));
+    }
+    return v;
+}
+
+int pch_get_int() {
+    int v = 0;
+    for (int i=0; i<4; i++) {
+        int c = pch_get_byte();
+        v = v | (c << (i * 8));
+    }
+    return v;
+}
+
+/*
+ * returns the string in the mapped cache (null-terminated)
+ */
+char *pch_get_str(int *len) {
+    int n = pch_get_int();
+    if (n < 0 || ctx->pch_in_pos + n + 1 > ctx->pch_in_len) {
+        ctx->pch_in_broken = TRUE;
+        n = 0;
+        ctx->pch_in_pos = ctx->pch_in_len;
+        return "";
+    }
+    char *s = ctx->pch_in + ctx->pch_in_pos;
+    ctx->pch_in_pos += n + 1;
+    if (len) {
+        *len = n;
+    }
+    return s;
+}
+
+bool pch_file_unchanged(char *path, long size, long mtime, long hash) {
+    long cur_size;
+    long cur_mtime;
+    if (!file_stat(path, &cur_size, &cur_mtime) || cur_size != size) {
+        return FALSE;
+    }
+    if (cur_mtime == mtime) {
+        return TRUE;
+    }
+    int fd = open(path, 0);
+    if (fd < 0) {
+        return FALSE;
+    }
+    int len;
+    char *body = map_file(fd, &len);
+    close(fd);
+    if (!body) {
+        return FALSE;
+    }
+    long body_hash = hash_bytes(body, len);
+    unmap_file(body);
+    return body_hash == hash;
+}
+
+void pch_get_token(token *t) {
+    t->id = pch_get_int();
+    long v = pch_get_long();
+    if (t->id == T_IDENT) {
+        if (!ctx->pch_in_idents[v]) {
+            ctx->pch_in_idents[v] = intern(ctx->pch_in_strings[v]);
+        }
+        t->str_value = ctx->pch_in_idents[v];
+    } else if (t->id == T_STRING) {
+        t->str_value = ctx->pch_in_strings[v];
+    } else if (t->id == T_UINT64) {
+        t->long_value = v;
+    } else if (t->id == T_CHAR) {
+        t->char_value = v;
+    } else {
+        t->int_value = v;
+    }
+    int src_index = pch_get_int();
+    t->src_id = ctx->pch_in_src_ids[src_index];
+    t->src_line = pch_get_int();
+    t->src_column = pch_get_int();
+    t->src_pos = pch_get_int();
+    t->src_end_pos = pch_get_int();
+}
+
+/*
+ * reads the header, the files, the macro dependencies and the '#pragma once' dependencies,
+ * and returns FALSE if the cache is not usable
+ */
+bool pch_validate(char *key) {
+    if (strcmp(pch_get_str(NULL), PCH_MAGIC) != 0 || pch_get_int() != ctx->pch_in_len) {
+        return FALSE;
+    }
+    if (strcmp(pch_get_str(NULL), key) != 0) {
+        return FALSE;
+    }
+    ctx->pch_in_files_pos = ctx->pch_in_pos;
+
+    int n = pch_get_int();
+    for (int i=0; i<n; i++) {
+        char *path = pch_get_str(NULL);
+        long size = pch_get_long();
+        long mtime = pch_get_long();
+        long hash = pch_get_long();
+        if (!pch_file_unchanged(path, size, mtime, hash)) {
+            debug("pch is outdated by %s", path);
+            return FALSE;
+        }
+    }
+
+    n = pch_get_int();
+    for (int i=0; i<n; i++) {
+        char *name = pch_get_str(NULL);
+        long hash = pch_get_long();
+        macro_t *m = find_macro(name);
+        long cur_hash = 0;
+        if (m) {
+            cur_hash = m->hash;
+        }
+        if (cur_hash != hash) {
+            debug("pch is not for the current definition of %s", name);
+            return FALSE;
+        }
+    }
+
+    n = pch_get_int();
+    for (int i=0; i<n; i++) {
+        char *path = pch_get_str(NULL);
+        bool included = pch_get_int();
+        char *guard = get_include_guard(path);
+        bool cur_included = FALSE;
+        if (guard && *guard == '\0') {
+            cur_included = TRUE;
+        }
+        if (ctx->pch_recording) {
+            // the current state, not the cached one: if this cache is not usable, re-lexing the
+            // file finds the same state, and its own note is dropped as a duplicate of this one
+            pch_note_once(path, cur_included);
+        }
+        if (cur_included != included) {
+            debug("pch is not for %s included or not as now", path);
+            return FALSE;
+        }
+    }
+    return !ctx->pch_in_broken;
+}
+
+char *pch_map_file(char *name, int *len) {
+    int fd = open(name, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    char *body = map_file(fd, len);
+    close(fd);
+    return body;
+}
+
+/*
+ * maps the cache file, or takes it from the keeper while the file is the same as when it was kept
+ */
+char *pch_map(char *name, int *len) {
+    context_t *keeper = ctx->pch_keeper;
+    long size;
+    long mtime;
+    if (!keeper || !file_stat(name, &size, &mtime)) {
+        return pch_map_file(name, len);
+    }
+    pch_kept_t *k = NULL;
+    if (keeper->pch_kept) {
+        k = str_map_get(keeper->pch_kept, name);
+    }
+    if (k && k->size == size && k->mtime == mtime) {
+        *len = k->len;
+        return k->body;
+    }
+
+    context_t *c = context_use(keeper); // the mapping and the record belong to the keeper
+    char *body = pch_map_file(name, len);
+    if (body) {
+        if (!ctx->pch_kept) {
+            ctx->pch_kept = str_map_new();
+            ctx->pch_retired = vec_new();
+        }
+        if (k) {
+            vec_push(ctx->pch_retired, k->body); // the current compile may still refer to it
+        } else {
+            k = arena_alloc(sizeof(pch_kept_t));
+            str_map_put(ctx->pch_kept, arena_strdup(name), k);
+        }
+        k->body = body;
+        k->len = *len;
+        k->size = size;
+        k->mtime = mtime;
+    }
+    context_use(c);
+    return body;
+}
+
+bool pch_load(char *path) {
+    char *key = pch_key(path);
+    char name[RCC_BUF_SIZE];
+    pch_file_name(name, key);
+    ctx->pch_in = pch_map(name, &ctx->pch_in_len);
+    if (!ctx->pch_in) {
+        return FALSE;
+    }
+    ctx->pch_in_pos = 0;
+    ctx->pch_in_broken = FALSE;
+
+    if (!pch_validate(key)) {
+        unmap_file(ctx->pch_in); // a kept one is not mapped by this context, and stays
+        return FALSE;
+    }
+    // from here on the cache is applied; the mapping is kept as the sources and strings live in it
+
+    int n = pch_get_int();
+    ctx->pch_in_strings = arena_alloc(n * sizeof(char *));
+    ctx->pch_in_idents = arena_alloc(n * sizeof(char *));
+    for (int i=0; i<n; i++) {
+        ctx->pch_in_strings[i] = pch_get_str(NULL);
+    }
+
+    n = pch_get_int();
+    ctx->pch_in_src_ids = arena_alloc(n * sizeof(int));
+    for (int i=0; i<n; i++) {
+        char *filename = pch_get_str(NULL);
+        char *src_path = pch_get_str(NULL);
+        int len;
+        char *body = pch_get_str(&len);
+        if (*src_path == '\0') {
+            src_path = NULL;
+        }
+        ctx->pch_in_src_ids[i] = add_src(filename, src_path, body, len);
+    }
+
+    n = pch_get_int();
+    for (int i=0; i<n; i++) {
+        char *macro_name = pch_get_str(NULL);
+        int body_len = pch_get_int();
+        if (body_len < 0) {
+            delete_macro(macro_name);
+            continue;
+        }
+        bool is_function = pch_get_int();
+        int nparams = pch_get_int();
+        int start = token_vec_len(ctx->tokens);
+        token_vec_extend(ctx->tokens, body_len);
+        for (int j=0; j<body_len; j++) {
+            pch_get_token(token_vec_get(ctx->tokens, start + j));
+        }
+        add_macro(macro_name, is_function, nparams, token_vec_get(ctx->tokens, start), body_len);
+        ctx->tokens->len = start;
+    }
+
+    n = pch_get_int();
+    int start = token_vec_len(ctx->tokens);
+    token_vec_extend(ctx->tokens, n);
+    for (int i=0; i<n; i++) {
+        pch_get_token(token_vec_get(ctx->tokens, start + i));
+    }
+
+    n = pch_get_int();
+    for (int i=0; i<n; i++) {
+        char *guard_path = pch_get_str(NULL);
+        char *guard = pch_get_str(NULL);
+        set_include_guard(guard_path, guard);
+        if (ctx->pch_recording) {
+            pch_note_guard(guard_path, guard);
+        }
+    }
+
+    if (ctx->pch_recording) {
+        // the outer files being recorded depend on the files of this one too
+        ctx->pch_in_pos = ctx->pch_in_files_pos;
+        n = pch_get_int();
+        for (int i=0; i<n; i++) {
+            char *file_path = pch_get_str(NULL);
+            long size = pch_get_long();
+            long mtime = pch_get_long();
+            long hash = pch_get_long();
+            pch_note_file(file_path, size, mtime, hash);
+        }
+    }
+
+    if (ctx->pch_in_broken) {
+        error("broken pch: %s", name);
+    }
+    ctx->pch_loaded++;
+    debug("loaded pch of %s: %d tokens", path, token_vec_len(ctx->tokens) - start);
+    return TRUE;
+}
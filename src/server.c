@@ -0,0 +1,254 @@
+#include "types.h"
+#include "rsys.h"
+#include "arena.h"
+#include "devtool.h"
+#include "rstring.h"
+#include "vec.h"
+#include "map.h"
+
+#include "server.h"
+
+#define AF_UNIX 1
+#define SOCK_STREAM 1
+#define SOL_SOCKET 1
+#define SCM_RIGHTS 1
+#define SIGPIPE 13
+#define SIG_IGN ((void *)1)
+#define UNIX_PATH_MAX 108
+
+#define CMSG_FDS_LEN 24  // cmsghdr with 2 fds: long len, int level, int type, int fds[2]
+
+/*
+ * fills struct sockaddr_un, and returns its length
+ */
+int unix_address(char *addr, char *path) {
+    int len = strlen(path);
+    if (len >= UNIX_PATH_MAX) {
+        error("too long socket path: %s", path);
+    }
+    addr[0] = AF_UNIX; // sun_family, a short
+    addr[1] = 0;
+    strcpy(addr + 2, path);
+    return 2 + len + 1;
+}
+
+/*
+ * fills struct msghdr with a single iovec and the control data
+ */
+void fill_msghdr(long *msg, long *iov, char *buf, int len, long *control, int control_len) {
+    iov[0] = (long)buf;
+    iov[1] = len;
+    msg[0] = 0;  // msg_name
+    msg[1] = 0;  // msg_namelen
+    msg[2] = (long)iov;
+    msg[3] = 1;
+    msg[4] = (long)control;
+    msg[5] = control_len;
+    msg[6] = 0;  // msg_flags
+}
+
+bool write_all(int fd, char *buf, int len) {
+    while (len > 0) {
+        int n = write(fd, buf, len);
+        if (n <= 0) {
+            return FALSE;
+        }
+        buf += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+bool read_all(int fd, char *buf, int len) {
+    while (len > 0) {
+        int n = read(fd, buf, len);
+        if (n <= 0) {
+            return FALSE;
+        }
+        buf += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+void put_int32(char *p, int v) {
+    for (int i=0; i<4; i++) {
+        p[i] = v >> (i * 8);
+    }
+}
+
+int get_int32(char *p) {
+    int v = 0;
+    for (int i=0; i<4; i++) {
+        int c = p[i];
+        v = v | ((c & 255) << (i * 8));
+    }
+    return v;
+}
+
+server_t *server_listen(char *path) {
+    char addr[UNIX_PATH_MAX + 2];
+    int addr_len = unix_address(addr, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        error("cannot create a socket");
+    }
+    unlink(path);
+    if (bind(sock, addr, addr_len) != 0 || listen(sock, 16) != 0) {
+        error("cannot listen on %s", path);
+    }
+    signal(SIGPIPE, SIG_IGN); // a client gone away must not stop the server
+
+    server_t *s = calloc(1, sizeof(server_t));
+    s->sock = sock;
+    s->conn = -1;
+    s->saved_out = dup(1);
+    s->saved_err = dup(2);
+    return s;
+}
+
+/*
+ * receives the length of the request with the client's stdout and stderr
+ */
+int recv_header(int conn, int *out, int *err) {
+    char header[4];
+    long iov[2];
+    long msg[7];
+    long control[3];
+    fill_msghdr(msg, iov, header, 4, control, CMSG_FDS_LEN);
+    if (recvmsg(conn, msg, 0) != 4 || msg[5] < CMSG_FDS_LEN) {
+        return -1;
+    }
+    int *cmsg = (int *)control;
+    if (cmsg[2] != SOL_SOCKET || cmsg[3] != SCM_RIGHTS) {
+        return -1;
+    }
+    *out = cmsg[4];
+    *err = cmsg[5];
+    return get_int32(header);
+}
+
+bool server_accept(server_t *s, char **level, int *argc, char ***argv) {
+    int conn = accept(s->sock, NULL, NULL);
+    if (conn < 0) {
+        error("cannot accept a request");
+    }
+    int out = -1;
+    int err = -1;
+    int len = recv_header(conn, &out, &err);
+    if (len <= 0) {
+        warning("dropped a broken request");
+        if (out >= 0) {
+            close(out); // the fds may have come with a broken length
+            close(err);
+        }
+        close(conn);
+        return FALSE;
+    }
+    char *body = arena_alloc(len);
+    if (!read_all(conn, body, len) || body[len - 1] != '\0') {
+        warning("dropped a broken request");
+        close(out);
+        close(err);
+        close(conn);
+        return FALSE;
+    }
+
+    // body: cwd, level, args... each null-terminated
+    int count = -2;
+    for (int i=0; i<len; i++) {
+        if (body[i] == '\0') {
+            count++;
+        }
+    }
+    char *cwd = body;
+    *level = cwd + strlen(cwd) + 1;
+    char *p = *level + strlen(*level) + 1;
+    *argc = max(count, 0);
+    *argv = arena_alloc((*argc + 1) * sizeof(char *));
+    for (int i=0; i<*argc; i++) {
+        (*argv)[i] = p;
+        p += strlen(p) + 1;
+    }
+
+    dup2(out, 1);
+    dup2(err, 2);
+    close(out);
+    close(err);
+    s->conn = conn;
+    if (chdir(cwd) != 0) {
+        warning("cannot enter %s", cwd);
+        server_reply(s, 1);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void server_reply(server_t *s, int status) {
+    dup2(s->saved_out, 1);
+    dup2(s->saved_err, 2);
+    char c = status;
+    write_all(s->conn, &c, 1);
+    close(s->conn);
+    s->conn = -1;
+}
+
+bool client_request(char *path, int argc, char **argv, int *status) {
+    char addr[UNIX_PATH_MAX + 2];
+    int addr_len = unix_address(addr, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        error("cannot create a socket");
+    }
+    if (connect(sock, addr, addr_len) != 0) {
+        close(sock);
+        return FALSE;
+    }
+
+    char cwd[RCC_BUF_SIZE];
+    if (!getcwd(cwd, RCC_BUF_SIZE)) {
+        error("cannot get the working dir");
+    }
+    char *level = getenv("RCC_LOG_LEVEL");
+    if (!level) {
+        level = "";
+    }
+    int len = strlen(cwd) + 1 + strlen(level) + 1;
+    for (int i=0; i<argc; i++) {
+        len += strlen(argv[i]) + 1;
+    }
+    char *body = arena_alloc(len);
+    char *p = body;
+    strcpy(p, cwd);
+    p += strlen(p) + 1;
+    strcpy(p, level);
+    p += strlen(p) + 1;
+    for (int i=0; i<argc; i++) {
+        strcpy(p, argv[i]);
+        p += strlen(p) + 1;
+    }
+
+    char header[4];
+    put_int32(header, len);
+    long iov[2];
+    long msg[7];
+    long control[3];
+    int *cmsg = (int *)control;
+    control[0] = CMSG_FDS_LEN;
+    cmsg[2] = SOL_SOCKET;
+    cmsg[3] = SCM_RIGHTS;
+    cmsg[4] = 1;
+    cmsg[5] = 2;
+    fill_msghdr(msg, iov, header, 4, control, CMSG_FDS_LEN);
+    if (sendmsg(sock, msg, 0) != 4 || !write_all(sock, body, len)) {
+        error("cannot send the request to %s", path);
+    }
+
+    char c;
+    if (!read_all(sock, &c, 1)) {
+        error("lost the server at %s", path);
+    }
+    *status = c;
+    close(sock);
+    return TRUE;
+}
@@ -0,0 +1,173 @@
+#include "types.h"
+#include "rsys.h"
+#include "arena.h"
+#include "rstring.h"
+#include "devtool.h"
+#include "vec.h"
+#include "map.h"
+
+#include "stats.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
+#define CLOCK_MONOTONIC 1
+#define RUSAGE_SELF 0
+
+long stats_clock() {
+    long ts[2]; // struct timespec
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    return ts[0] * 1000000 + ts[1] / 1000;
+}
+
+long stats_start() {
+    if (!ctx->stats) {
+        return 0;
+    }
+    return stats_clock();
+}
+
+void stats_phase(char *name, long start) {
+    if (!ctx->stats) {
+        return;
+    }
+    if (!ctx->stats_phase_names) {
+        ctx->stats_phase_names = char_p_vec_new();
+        ctx->stats_phase_times = int_vec_new();
+    }
+    char_p_vec_push(ctx->stats_phase_names, name);
+    int_vec_push(ctx->stats_phase_times, stats_clock() - start);
+}
+
+/*
+ * in kilobytes
+ */
+int peak_rss() {
+    long usage[18]; // struct rusage
+    if (getrusage(RUSAGE_SELF, usage) != 0) {
+        return 0;
+    }
+    return usage[4]; // ru_maxrss
+}
+
+/*
+ * s is cut short to keep buf, of size bytes, terminated with the closing quote
+ */
+void append_json_string(char *buf, int size, char *s) {
+    int i = strlen(buf);
+    int end = size - 2; // the closing quote and the terminator
+    if (i + 1 > end) {
+        return;
+    }
+    buf[i++] = '"';
+    for (; *s; s++) {
+        int c = *s;
+        if (c == '"' || c == '\\') {
+            if (i + 2 > end) {
+                break;
+            }
+            buf[i++] = '\\';
+            buf[i++] = c;
+        } else if (c >= 0 && c < ' ') {
+            if (i + 6 > end) {
+                break;
+            }
+            snprintf(buf + i, 8, "\\u%04x", c);
+            i += 6;
+        } else {
+            if (i + 1 > end) {
+                break;
+            }
+            buf[i++] = c;
+        }
+    }
+    buf[i++] = '"';
+    buf[i] = '\0';
+}
+
+/*
+ * appends a line of the text report, or a member of the JSON object
+ */
+void append_stat(char *buf, long size, char *name, int value) {
+    long len = strlen(buf); // a long for the size of snprintf(): rcc does not widen an int argument
+    if (ctx->stats == STATS_JSON) {
+        snprintf(buf + len, size - len, ",\"%s\":%d", name, value);
+    } else {
+        snprintf(buf + len, size - len, "  %-16s %d\n", name, value);
+    }
+}
+
+void stats_report(char *filename) {
+    if (!ctx->stats) {
+        return;
+    }
+    long size = RCC_BUF_SIZE * 4;
+    char *buf = arena_alloc(size);
+    bool json = FALSE;
+    if (ctx->stats == STATS_JSON) {
+        json = TRUE;
+    }
+    if (json) {
+        strcpy(buf, "{\"file\":");
+        append_json_string(buf, RCC_BUF_SIZE, filename); // the rest fits in the other 3/4
+        strcat(buf, ",\"phases_us\":{");
+    } else {
+        snprintf(buf, RCC_BUF_SIZE, "stats of %s\n", filename);
+    }
+
+    int total = 0;
+    int phases = 0;
+    if (ctx->stats_phase_names) {
+        phases = char_p_vec_len(ctx->stats_phase_names);
+    }
+    for (int i=0; i<phases; i++) {
+        char *name = *char_p_vec_get(ctx->stats_phase_names, i);
+        int us = *int_vec_get(ctx->stats_phase_times, i);
+        total += us;
+        long len = strlen(buf);
+        if (json) {
+            snprintf(buf + len, size - len, "%s\"%s\":%d", (i > 0) ? "," : "", name, us);
+        } else {
+            snprintf(buf + len, size - len, "  %-16s %d.%03d ms\n", name, us / 1000, us % 1000);
+        }
+    }
+    long len = strlen(buf);
+    if (json) {
+        snprintf(buf + len, size - len, "},\"total_us\":%d", total);
+    } else {
+        snprintf(buf + len, size - len, "  %-16s %d.%03d ms\n", "total", total / 1000, total % 1000);
+    }
+
+    int pch_loaded;
+    int pch_written;
+    pch_stats(&pch_loaded, &pch_written);
+    int types = 0;
+    if (ctx->types) {
+        types = type_vec_len(ctx->types);
+    }
+    append_stat(buf, size, "tokens", token_vec_len(ctx->tokens));
+    append_stat(buf, size, "atoms", atom_count());
+    append_stat(buf, size, "types", types);
+    append_stat(buf, size, "vars", ctx->vars_added);
+    append_stat(buf, size, "functions", func_vec_len(ctx->functions));
+    append_stat(buf, size, "macro_expansions", ctx->macro_expansions);
+    append_stat(buf, size, "includes", ctx->includes);
+    append_stat(buf, size, "pch_loaded", pch_loaded);
+    append_stat(buf, size, "lines_emitted", ctx->emitted_lines);
+    append_stat(buf, size, "arena_kb", arena_allocated() / 1024);
+    append_stat(buf, size, "arena_heap_calls", ctx->arena_heap_calls);
+    append_stat(buf, size, "peak_rss_kb", peak_rss());
+    if (json) {
+        strcat(buf, "}\n");
+    }
+    write(2, buf, strlen(buf));
+}
@@ -1,54 +1,57 @@
 #include "types.h"
 #include "vec.h"
 #include "rsys.h"
+#include "arena.h"
 #include "rstring.h"
 #include "devtool.h"
+#include "map.h"
+
+#include "intern.h"
 
-#include "file.h"
-#include "macro.h"
 #include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
 #include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "trace.h"
+#include "context.h"
 
-VEC_HEADER(bool, bool_vec)
 VEC_BODY(bool, bool_vec)
 
-bool_vec ifdef_skips = 0;
-
 void ifdef_start(bool skip) {
-    bool_vec_push(ifdef_skips, skip);
+    bool_vec_push(ctx->ifdef_skips, skip);
 }
 
 void ifdef_else() {
-    if (bool_vec_len(ifdef_skips) == 0) {
+    if (bool_vec_len(ctx->ifdef_skips) == 0) {
         error("found #else without #ifdef/ifndef");
     }
-    bool_vec_set(ifdef_skips, bool_vec_len(ifdef_skips) -1, !(*bool_vec_top(ifdef_skips)));
+    bool_vec_set(ctx->ifdef_skips, bool_vec_len(ctx->ifdef_skips) -1, !(*bool_vec_top(ctx->ifdef_skips)));
 }
 
 bool ifdef_skip() {
-    if (!ifdef_skips) ifdef_skips = bool_vec_new();
-    if (bool_vec_len(ifdef_skips) == 0) return FALSE;
-    return *bool_vec_top(ifdef_skips);
+    if (bool_vec_len(ctx->ifdef_skips) == 0) return FALSE;
+    return *bool_vec_top(ctx->ifdef_skips);
 }
 
 void ifdef_end() {
-    if (bool_vec_len(ifdef_skips) == 0) {
+    if (bool_vec_len(ctx->ifdef_skips) == 0) {
         error("found #endif without #ifdef/ifndef");
     }
-    bool_vec_pop(ifdef_skips);
+    bool_vec_pop(ctx->ifdef_skips);
 }
 
-VEC_HEADER(token, token_vec)
-VEC_BODY(token, token_vec)
-
-token_vec tokens;
-
-int token_pos = 0;
+VEC_INLINE_BODY(token, token_vec)
 
 void set_src_pos() {
-    src->prev_column = src->column;
-    src->prev_pos = src->pos;
-    src->prev_line = src->line;
+    ctx->src->prev_column = ctx->src->column;
+    ctx->src->prev_pos = ctx->src->pos;
+    ctx->src->prev_line = ctx->src->line;
 }
 
 void to_eol() {
@@ -59,14 +62,12 @@ void skip() {
     while (!is_eof()) {
         int c = ch();
         if (c == '/') { // scan comment
-            int pos = src->pos;
+            int pos = ctx->src->pos;
             next();
             if (ch() == '/') {
-                debug("scanning //...");
                 to_eol();
             } else if (ch() == '*') {
                 next();
-                debug("scanning /*...");
                 while (!is_eof()) {
                     if (ch() == '*') {
                         next();
@@ -77,7 +78,7 @@ void skip() {
                     next();
                 }
             } else {
-                src->pos = pos;
+                ctx->src->pos = pos;
                 break;
             }
         } else if (!is_space(c)) {
@@ -99,10 +100,10 @@ bool accept_char(char c) {
 
 bool accept_string(char *str) {
     skip();
-    int old_pos = src->pos;
+    int old_pos = ctx->src->pos;
     for (;*str != 0; str++) {
         if (ch() != *str) {
-            src->pos = old_pos;
+            ctx->src->pos = old_pos;
             return FALSE;
         }
         next();
@@ -112,10 +113,10 @@ bool accept_string(char *str) {
 
 bool accept_ident(char *str) {
     skip();
-    int old_pos = src->pos;
+    int old_pos = ctx->src->pos;
     for (;*str != 0; str++) {
         if (ch() != *str) {
-            src->pos = old_pos;
+            ctx->src->pos = old_pos;
             return FALSE;
         }
         next();
@@ -124,7 +125,7 @@ bool accept_ident(char *str) {
     if (!is_alpha(c) && !is_digit(c) && c != '_') {
         return TRUE;
     }
-    src->pos = old_pos;
+    ctx->src->pos = old_pos;
     return FALSE;
 }
 
@@ -143,7 +144,7 @@ bool tokenize_int_hex(long *retval, int *size) {
     }
     next();
     if (ch() != 'x' && ch() != 'X') {
-        src->pos--;
+        ctx->src->pos--;
         return FALSE;
     }
     next();
@@ -196,6 +197,8 @@ bool tokenize_int_decimal(long *retval, int *size) {
     return (count != 0);
 }
 
+bool follow(char c);
+
 bool tokenize_int(long *retval, int *size) {
     *size = 4;
     skip();
@@ -203,7 +206,7 @@ bool tokenize_int(long *retval, int *size) {
       && !tokenize_int_oct(retval, size)
       && !tokenize_int_decimal(retval, size)) return FALSE;
     
-    if (accept_char('L') || accept_char('l')) {
+    if (follow('L') || follow('l')) {
         *size = 8;
     }
     return TRUE;
@@ -257,7 +260,7 @@ bool tokenize_string(char **retval) {
         next();
     }
 
-    str = malloc(buf_pos + 1);
+    str = arena_alloc(buf_pos + 1);
     for (i=0; i<buf_pos; i++) {
         str[i] = buf[i];
     }
@@ -289,21 +292,189 @@ bool tokenize_ident(char **retval) {
         return FALSE;
     }
 
-    *retval = strdup(buf);
+    *retval = intern(buf);
+    return TRUE;
+}
+
+bool follow(char c) {
+    if (ch() == c) {
+        next();
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * operators and punctuators: dispatched on the first char, then the longest match wins
+ */
+bool tokenize_punct(token_id *retval) {
+    token_id id;
+    switch (ch()) {
+    case '(': next(); id = T_LPAREN; break;
+    case ')': next(); id = T_RPAREN; break;
+    case '{': next(); id = T_LBLACE; break;
+    case '}': next(); id = T_RBLACE; break;
+    case '[': next(); id = T_LBRACKET; break;
+    case ']': next(); id = T_RBRACKET; break;
+    case ':': next(); id = T_COLON; break;
+    case ';': next(); id = T_SEMICOLON; break;
+    case ',': next(); id = T_COMMA; break;
+    case '?': next(); id = T_QUESTION; break;
+    case '!': next(); id = follow('=') ? T_NE : T_L_NOT; break;
+    case '=': next(); id = follow('=') ? T_EQ : T_EQUAL; break;
+    case '^': next(); id = follow('=') ? T_HAT_EQUAL : T_HAT; break;
+    case '~': next(); id = follow('=') ? T_TILDE_EQUAL : T_TILDE; break;
+    case '*': next(); id = follow('=') ? T_ASTERISK_EQUAL : T_ASTERISK; break;
+    case '/': next(); id = follow('=') ? T_SLASH_EQUAL : T_SLASH; break;
+    case '%': next(); id = follow('=') ? T_PERCENT_EQUAL : T_PERCENT; break;
+    case '&':
+        next();
+        if (follow('&')) {
+            id = T_L_AND;
+        } else if (follow('=')) {
+            id = T_AMP_EQUAL;
+        } else {
+            id = T_AMP;
+        }
+        break;
+    case '|':
+        next();
+        if (follow('|')) {
+            id = T_L_OR;
+        } else if (follow('=')) {
+            id = T_PIPE_EQUAL;
+        } else {
+            id = T_PIPE;
+        }
+        break;
+    case '+':
+        next();
+        if (follow('+')) {
+            id = T_INC;
+        } else if (follow('=')) {
+            id = T_PLUS_EQUAL;
+        } else {
+            id = T_PLUS;
+        }
+        break;
+    case '-':
+        next();
+        if (follow('-')) {
+            id = T_DEC;
+        } else if (follow('=')) {
+            id = T_MINUS_EQUAL;
+        } else if (follow('>')) {
+            id = T_ALLOW;
+        } else {
+            id = T_MINUS;
+        }
+        break;
+    case '<':
+        next();
+        if (follow('=')) {
+            id = T_LE;
+        } else if (follow('<')) {
+            id = follow('=') ? T_LSHIFT_EQUAL : T_LSHIFT;
+        } else {
+            id = T_LT;
+        }
+        break;
+    case '>':
+        next();
+        if (follow('=')) {
+            id = T_GE;
+        } else if (follow('>')) {
+            id = follow('=') ? T_RSHIFT_EQUAL : T_RSHIFT;
+        } else {
+            id = T_GT;
+        }
+        break;
+    case '.':
+        next();
+        if (ch() == '.' && ch_next() == '.') {
+            next();
+            next();
+            id = T_3DOT;
+        } else {
+            id = T_PERIOD;
+        }
+        break;
+    default:
+        return FALSE;
+    }
+    *retval = id;
+    return TRUE;
+}
+
+/*
+ * keywords are looked up by a perfect hash over (length, first char, last char).
+ * the table holds interned names, so a hit is a pointer compare.
+ */
+#define KEYWORD_TABLE_SIZE 32
+
+int keyword_hash(char *name) {
+    int len = strlen(name);
+    return (len * 19 + name[0] + name[len-1] * 9) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+void add_keyword(char *name, token_id id) {
+    int h = keyword_hash(name);
+    if (ctx->keyword_names[h]) {
+        error("keyword hash collision: %s and %s", name, ctx->keyword_names[h]);
+    }
+    ctx->keyword_names[h] = intern(name);
+    ctx->keyword_ids[h] = id;
+}
+
+void init_keywords() {
+    if (ctx->keyword_names) {
+        return;
+    }
+    ctx->keyword_names = arena_alloc(KEYWORD_TABLE_SIZE * sizeof(char *));
+    ctx->keyword_ids = arena_alloc(KEYWORD_TABLE_SIZE * sizeof(token_id));
+    add_keyword("break", T_BREAK);
+    add_keyword("case", T_CASE);
+    add_keyword("const", T_CONST);
+    add_keyword("continue", T_CONTINUE);
+    add_keyword("default", T_DEFAULT);
+    add_keyword("do", T_DO);
+    add_keyword("else", T_ELSE);
+    add_keyword("extern", T_EXTERN);
+    add_keyword("for", T_FOR);
+    add_keyword("if", T_IF);
+    add_keyword("return", T_RETURN);
+    add_keyword("sizeof", T_SIZEOF);
+    add_keyword("struct", T_STRUCT);
+    add_keyword("switch", T_SWITCH);
+    add_keyword("typedef", T_TYPEDEF);
+    add_keyword("union", T_UNION);
+    add_keyword("enum", T_ENUM);
+    add_keyword("while", T_WHILE);
+}
+
+/*
+ * name must be interned
+ */
+bool find_keyword(char *name, token_id *retval) {
+    int h = keyword_hash(name);
+    if (ctx->keyword_names[h] != name) {
+        return FALSE;
+    }
+    *retval = ctx->keyword_ids[h];
     return TRUE;
 }
 
 token *add_token(token_id id) {
     token t;
     t.id = id;
-    t.src_id = src->id;
-    t.src_line = src->prev_line;
-    t.src_column = src->prev_column;
-    t.src_pos = src->prev_pos;
-    t.src_end_pos = src->pos - 1;
+    t.src_id = ctx->src->id;
+    t.src_line = ctx->src->prev_line;
+    t.src_column = ctx->src->prev_column;
+    t.src_pos = ctx->src->prev_pos;
+    t.src_end_pos = ctx->src->pos - 1;
 
     set_src_pos();
-    return token_vec_push(tokens, t);
+    return token_vec_push(ctx->tokens, t);
 }
 
 void add_int_token(int val) {
@@ -333,29 +504,98 @@ void add_ident_token(char *s) {
 
 void dump_token(int pos, token *t) {
     src_t *s = file_info(t->src_id);
-    debug("token:#%d: id:%d src_id:%d %s:%d:%d |%s|", pos, t->id, t->src_id, s->filename, t->src_line, t->src_column, dump_file(t->src_id, t->src_pos, t->src_end_pos));
+    info("token:#%d: id:%d src_id:%d %s:%d:%d |%s|", pos, t->id, t->src_id, s->filename, t->src_line, t->src_column, dump_file(t->src_id, t->src_pos, t->src_end_pos));
 }
 
 void dump_token_simple(char *buf, int pos) {
-    token *t = token_vec_get(tokens, pos);
+    token *t = token_vec_get(ctx->tokens, pos);
     src_t *s = file_info(t->src_id);
 
     snprintf(buf, RCC_BUF_SIZE, "%s:%d:%d |%s|", s->filename, t->src_line, t->src_column, dump_file(t->src_id, t->src_pos, t->src_end_pos));
 }
 
 void dump_tokens() {
-    int i = token_pos;
-    if (i<0 || i>=token_vec_len(tokens)) {
+    if (!ctx || !ctx->tokens) {
         return;
     }
-    dump_token(i, token_vec_get(tokens, i));
+    int i = ctx->token_pos;
+    if (i<0 || i>=token_vec_len(ctx->tokens)) {
+        return;
+    }
+    dump_token(i, token_vec_get(ctx->tokens, i));
 }
 
 void tokenize();
+void lex_token();
+void move_tokens(int start, token_vec out);
+
+void add_include_guard(char *path, char *guard) {
+    set_include_guard(path, guard);
+    if (ctx->pch_recording) {
+        pch_note_guard(path, guard);
+    }
+}
+
+/*
+ * a '#pragma once' file included for the first time: the files being recorded depend on that
+ */
+void note_once_included(char *path) {
+    if (!ctx->pch_recording || !path) {
+        return;
+    }
+    char *guard = get_include_guard(path);
+    if (guard && *guard == '\0') {
+        pch_note_once(path, FALSE);
+    }
+}
+
+/*
+ * tokenizes the file unless it is guarded, or replays its precompiled tokens
+ */
+void include_file(char *filename) {
+    char *path = find_file(filename);
+    char *guard = NULL;
+    if (path) {
+        guard = get_include_guard(path);
+    }
+    if (guard && (*guard == '\0' || find_macro(guard))) {
+        debug("skipped guarded include: %s", path);
+        if (*guard == '\0' && ctx->pch_recording) {
+            pch_note_once(path, TRUE); // find_macro() has noted the guard macro of the others
+        }
+        return;
+    }
+    ctx->includes++;
+    trace_begin("include", filename);
+    if (ctx->pch_dir && path && pch_load(path)) {
+        note_once_included(path);
+        trace_end();
+        return;
+    }
+
+    if (ctx->pch_dir && path) {
+        pch_begin(path, bool_vec_len(ctx->ifdef_skips));
+    }
+    enter_file_path(filename, path);
+    if (ctx->pch_recording) {
+        long size;
+        long mtime;
+        if (file_stat(path, &size, &mtime)) {
+            pch_note_file(path, size, mtime, hash_bytes(ctx->src->body, ctx->src->len));
+        }
+    }
+    tokenize();
+    exit_file();
+    if (ctx->pch_dir && path) {
+        pch_end(bool_vec_len(ctx->ifdef_skips));
+    }
+    note_once_included(path);
+    trace_end();
+}
 
 void directive_include() {
     if (accept_char('\"')) {
-        char *filename = calloc(RCC_BUF_SIZE,1);
+        char *filename = arena_alloc(RCC_BUF_SIZE);
         int i=0;
         while (ch() != '\"') {
             if (i>=100) {
@@ -367,34 +607,76 @@ void directive_include() {
         filename[i] = '\0';
         next();
 
-        enter_file(filename);
-        tokenize();
-        exit_file();
+        include_file(filename);
     } else {
         error("no file name for #include");
     }
 }
 
+/*
+ * lexes the rest of the line as a macro body onto tokens and returns its start position.
+ * parameter names become T_MACRO_PARAM and '##' becomes T_PASTE.
+ */
+int lex_macro_body(char_p_vec vars) {
+    int line = ctx->src->line;
+    int column = ctx->src->column;
+    int pos = ctx->src->pos;
+    to_eol();
+    int len = ctx->src->len;
+    ctx->src->len = ctx->src->pos;
+    ctx->src->pos = pos;
+    ctx->src->line = line;
+    ctx->src->column = column;
+
+    int start = token_vec_len(ctx->tokens);
+    skip();
+    while (!is_eof()) {
+        if (accept_string("##")) {
+            add_token(T_PASTE);
+        } else if (ch() == '#') {
+            error("'#' operator is not supported in macro body: %s:%d:%d", ctx->src->filename, ctx->src->line, ctx->src->column);
+        } else {
+            lex_token();
+            token *t = token_vec_top(ctx->tokens);
+            if (t->id == T_IDENT) {
+                for (int i=0; i<vars->len; i++) {
+                    if (*char_p_vec_get(vars, i) == t->str_value) {
+                        t->id = T_MACRO_PARAM;
+                        t->int_value = i;
+                        break;
+                    }
+                }
+            }
+        }
+        skip();
+    }
+    ctx->src->len = len;
+    return start;
+}
+
 void directive_define() {
     char *name;
     if (!tokenize_ident(&name)) error("no identifier for define directive");
 
-    char_p_vec vars = char_p_vec_new();
+    char_p_vec vars = ctx->macro_params;
+    vars->len = 0;
+    bool is_function = FALSE;
     if (ch() == ('(')) {
         next();
-        while (vars->len == 0 || accept_char(',')) {
-            char *var_name;
-            if (!tokenize_ident(&var_name)) error("invalid macro arg declaration");
-            char_p_vec_push(vars, var_name);
+        is_function = TRUE;
+        if (!accept_char(')')) {
+            while (vars->len == 0 || accept_char(',')) {
+                char *var_name;
+                if (!tokenize_ident(&var_name)) error("invalid macro arg declaration");
+                char_p_vec_push(vars, var_name);
+            }
+            if (!accept_char(')')) error("stray macro args end");
         }
-        if (!accept_char(')')) error("stray macro args end");
     }
 
-    skip();
-    int start_pos = src->pos;
-    to_eol();
-    int end_pos = src->pos - 1;
-    add_macro(name, start_pos, end_pos, vars);
+    int start = lex_macro_body(vars);
+    add_macro(name, is_function, vars->len, token_vec_get(ctx->tokens, start), token_vec_len(ctx->tokens) - start);
+    ctx->tokens->len = start;
 }
 
 void directive_undef() {
@@ -404,7 +686,25 @@ void directive_undef() {
     delete_macro(name);
 }
 
-void preprocess() {
+void directive_pragma() {
+    if (accept_ident("once")) {
+        if (ctx->src->path) {
+            add_include_guard(ctx->src->path, "");
+        }
+    } else {
+        to_eol(); // unknown pragmas are ignored
+    }
+}
+
+typedef enum {
+    DIRECTIVE_OTHER,
+    DIRECTIVE_IFNDEF,
+    DIRECTIVE_ELSE,
+    DIRECTIVE_ENDIF
+} directive_e;
+
+directive_e preprocess() {
+    directive_e d = DIRECTIVE_OTHER;
     if (accept_ident("ifdef")) {
         bool skip = FALSE;
         if (!ifdef_skip()) {
@@ -419,12 +719,16 @@ void preprocess() {
             char *name;
             if (!tokenize_ident(&name)) error("#ifndef needs a identifier");
             skip = (bool)(find_macro(name) != NULL);
+            ctx->ifndef_name = name;
+            d = DIRECTIVE_IFNDEF;
         }
         ifdef_start(skip);
     } else if (accept_ident("else")) {
         ifdef_else();
+        d = DIRECTIVE_ELSE;
     } else if (accept_ident("endif")) {
         ifdef_end();
+        d = DIRECTIVE_ENDIF;
     } else if (!ifdef_skip()) {
         if (accept_ident("include")) {
             directive_include();
@@ -432,283 +736,249 @@ void preprocess() {
             directive_define();
         } else if (accept_ident("undef")) {
             directive_undef();
+        } else if (accept_ident("pragma")) {
+            directive_pragma();
         } else {
             error("unknown directive");
         }
     }
     set_src_pos();
+    return d;
 }
 
-void tokenize() {
-    int concat_start_token_pos = -1;
+/*
+ * lexes one token at the current position and appends it to tokens. macros are not expanded here.
+ */
+void lex_token() {
+    token_id id;
+    long i;
+    int size;
+    char c;
+    char *str;
+    if (tokenize_punct(&id)) {
+        add_token(id);
+    } else if (tokenize_int(&i, &size)) {
+        if (size == 8) {
+            add_long_token(i);
+        } else {
+            add_int_token(i);
+        }
+    } else if (tokenize_char(&c)) {
+        add_char_token(c);
+    } else if (tokenize_string(&str)) {
+        add_string_token(str);
+    } else if (tokenize_ident(&str)) {
+        if (find_keyword(str, &id)) {
+            add_token(id);
+        } else {
+            add_ident_token(str);
+        }
+    } else {
+        error("invalid_token: %s:%d:%d [%d] %s => %s", 
+            ctx->src->filename, ctx->src->line, ctx->src->column, ch(), 
+            _slice(&(ctx->src->body[max(ctx->src->pos - 20, 0)]), min(ctx->src->pos, 20)),
+            _slice(&(ctx->src->body[ctx->src->pos]), min(ctx->src->len - ctx->src->pos, 20)));
+    }
+}
+
+/*
+ * moves tokens[start..] to the end of out
+ */
+void move_tokens(int start, token_vec out) {
+    for (int i=start; i<token_vec_len(ctx->tokens); i++) {
+        token t = *token_vec_get(ctx->tokens, i);
+        token_vec_push(out, t);
+    }
+    ctx->tokens->len = start;
+}
 
+/*
+ * lexes text, which is the result of '##', and appends the tokens to out
+ */
+void lex_text(char *text, token_vec out) {
+    int start = token_vec_len(ctx->tokens);
+    enter_new_file(ctx->src->filename, text, 0, strlen(text), 1, 1);
+    skip();
     while (!is_eof()) {
-        if (accept_char('#')) {
-            preprocess();
+        lex_token();
+        skip();
+    }
+    exit_file();
+    move_tokens(start, out);
+}
 
-        } else if (ifdef_skip()) {
-            to_eol();
-            set_src_pos();
+/*
+ * lexes the '(' ... ')' following the name of a function-like macro and appends the tokens to out.
+ * returns FALSE if the next char is not '(', in which case the name is not a macro invocation.
+ */
+bool lex_macro_args(token_vec out) {
+    skip();
+    if (ch() != '(') {
+        return FALSE;
+    }
+    int start = token_vec_len(ctx->tokens);
+    int depth = 0;
+    for (;;) {
+        if (is_eof()) {
+            error("stray eof while parsing macro args");
+        }
+        lex_token();
+        token_id id = token_vec_top(ctx->tokens)->id;
+        if (id == T_LPAREN) {
+            depth++;
+        } else if (id == T_RPAREN) {
+            depth--;
+            if (depth == 0) {
+                break;
+            }
+        }
+        skip();
+    }
+    move_tokens(start, out);
+    return TRUE;
+}
 
-        } else if (accept_string("!=")) {
-            add_token(T_NE);
-        } else if (accept_char('!')) {
-            add_token(T_L_NOT);
-        } else if (accept_char('?')) {
-            add_token(T_QUESTION);
-        } else if (accept_string("==")) {
-            add_token(T_EQ);
-        } else if (accept_string("&&")) {
-            add_token(T_L_AND);
-        } else if (accept_string("&=")) {
-            add_token(T_AMP_EQUAL);
-        } else if (accept_char('&')) {
-            add_token(T_AMP);
-        } else if (accept_string("||")) {
-            add_token(T_L_OR);
-        } else if (accept_string("|=")) {
-            add_token(T_PIPE_EQUAL);
-        } else if (accept_char('|')) {
-            add_token(T_PIPE);
-        } else if (accept_string("^=")) {
-            add_token(T_HAT_EQUAL);
-        } else if (accept_char('^')) {
-            add_token(T_HAT);
-        } else if (accept_string("~=")) {
-            add_token(T_TILDE_EQUAL);
-        } else if (accept_char('~')) {
-            add_token(T_TILDE);
-        } else if (accept_char('=')) {
-            add_token(T_EQUAL);
-        } else if (accept_string("<=")) {
-            add_token(T_LE);
-        } else if (accept_string("<<=")) {
-            add_token(T_LSHIFT_EQUAL);
-        } else if (accept_string("<<")) {
-            add_token(T_LSHIFT);
-        } else if (accept_char('<')) {
-            add_token(T_LT);
-        } else if (accept_string(">=")) {
-            add_token(T_GE);
-        } else if (accept_string(">>=")) {
-            add_token(T_RSHIFT_EQUAL);
-        } else if (accept_string(">>")) {
-            add_token(T_RSHIFT);
-        } else if (accept_char('>')) {
-            add_token(T_GT);
-        } else if (accept_string("*=")) {
-            add_token(T_ASTERISK_EQUAL);
-        } else if (accept_char('*')) {
-            add_token(T_ASTERISK);
-        } else if (accept_string("/=")) {
-            add_token(T_SLASH_EQUAL);
-        } else if (accept_char('/')) {
-            add_token(T_SLASH);
-        } else if (accept_string("%=")) {
-            add_token(T_PERCENT_EQUAL);
-        } else if (accept_char('%')) {
-            add_token(T_PERCENT);
-        } else if (accept_string("++")) {
-            add_token(T_INC);
-        } else if (accept_string("+=")) {
-            add_token(T_PLUS_EQUAL);
-        } else if (accept_char('+')) {
-            add_token(T_PLUS);
-        } else if (accept_string("--")) {
-            add_token(T_DEC);
-        } else if (accept_string("-=")) {
-            add_token(T_MINUS_EQUAL);
-        } else if (accept_string("->")) {
-            add_token(T_ALLOW);
-        } else if (accept_char('-')) {
-            add_token(T_MINUS);
-        } else if (accept_char('{')) {
-            add_token(T_LBLACE);
-        } else if (accept_char('}')) {
-            add_token(T_RBLACE);
-        } else if (accept_char('[')) {
-            add_token(T_LBRACKET);
-        } else if (accept_char(']')) {
-            add_token(T_RBRACKET);
-        } else if (accept_char('(')) {
-            add_token(T_LPAREN);
-        } else if (accept_char(')')) {
-            add_token(T_RPAREN);
-        } else if (accept_char(':')) {
-            add_token(T_COLON);
-        } else if (accept_char(';')) {
-            add_token(T_SEMICOLON);
-        } else if (accept_string("...")) {
-            add_token(T_3DOT);
-        } else if (accept_char('.')) {
-            add_token(T_PERIOD);
-        } else if (accept_char(',')) {
-            add_token(T_COMMA);
-        } else if (accept_ident("break")) {
-            add_token(T_BREAK);
-        } else if (accept_ident("case")) {
-            add_token(T_CASE);
-        } else if (accept_ident("const")) {
-            add_token(T_CONST);
-        } else if (accept_ident("continue")) {
-            add_token(T_CONTINUE);
-        } else if (accept_ident("default")) {
-            add_token(T_DEFAULT);
-        } else if (accept_ident("do")) {
-            add_token(T_DO);
-        } else if (accept_ident("else")) {
-            add_token(T_ELSE);
-        } else if (accept_ident("extern")) {
-            add_token(T_EXTERN);
-        } else if (accept_ident("for")) {
-            add_token(T_FOR);
-        } else if (accept_ident("if")) {
-            add_token(T_IF);
-        } else if (accept_ident("return")) {
-            add_token(T_RETURN);
-        } else if (accept_ident("sizeof")) {
-            add_token(T_SIZEOF);
-        } else if (accept_ident("struct")) {
-            add_token(T_STRUCT);
-        } else if (accept_ident("switch")) {
-            add_token(T_SWITCH);
-        } else if (accept_ident("typedef")) {
-            add_token(T_TYPEDEF);
-        } else if (accept_ident("union")) {
-            add_token(T_UNION);
-        } else if (accept_ident("enum")) {
-            add_token(T_ENUM);
-        } else if (accept_ident("while")) {
-            add_token(T_WHILE);
-        } else {
-            long i;
-            int size;
-            char c;
-            char *str;
-            if (tokenize_int(&i, &size)) {
-                if (size == 8) {
-                    add_long_token(i);
+/*
+ * include guard detection: a file is guarded when its first directive is '#ifndef X'
+ * and nothing but blanks and comments follows the matching '#endif'.
+ */
+typedef enum {
+    GUARD_START,   // nothing seen yet
+    GUARD_OPEN,    // in the first #ifndef
+    GUARD_CLOSED,  // after its #endif
+    GUARD_NONE     // not guarded
+} guard_state_e;
+
+void tokenize() {
+    int depth = bool_vec_len(ctx->ifdef_skips);
+    guard_state_e guard_state = GUARD_START;
+    char *guard = NULL;
+
+    while (!is_eof()) {
+        if (accept_char('#')) {
+            directive_e d = preprocess();
+            if (guard_state == GUARD_START) {
+                if (d == DIRECTIVE_IFNDEF) {
+                    guard_state = GUARD_OPEN;
+                    guard = ctx->ifndef_name;
                 } else {
-                    add_int_token(i);
+                    guard_state = GUARD_NONE;
                 }
-            } else if (tokenize_char(&c)) {
-                add_char_token(c);
-            } else if (tokenize_string(&str)) {
-                add_string_token(str);
-            } else if (tokenize_ident(&str)) {
-                if (enter_macro(str)) {
-                    tokenize();
-                    exit_macro();
-                } else {
-                    add_ident_token(str);
+            } else if (guard_state == GUARD_OPEN) {
+                if (bool_vec_len(ctx->ifdef_skips) == depth) {
+                    guard_state = GUARD_CLOSED;
+                } else if (d == DIRECTIVE_ELSE && bool_vec_len(ctx->ifdef_skips) == depth + 1) {
+                    guard_state = GUARD_NONE;
                 }
             } else {
-                error("invalid_token: %s:%d:%d [%d] %s => %s", 
-                    src->filename, src->line, src->column, ch(), 
-                    _slice(&(src->body[max(src->pos - 20, 0)]), 20),
-                    _slice(&(src->body[src->pos]), 20));
+                guard_state = GUARD_NONE;
             }
-        }
 
-        // do macro string concatination
-        if (accept_string("##")) {
-            if (concat_start_token_pos == -1) {
-                concat_start_token_pos = token_vec_len(tokens) - 1;
+        } else if (ifdef_skip()) {
+            to_eol();
+            set_src_pos();
+
+        } else {
+            if (guard_state != GUARD_OPEN) {
+                guard_state = GUARD_NONE;
             }
-        } else if (concat_start_token_pos != -1) {
-            char *buf = calloc(RCC_BUF_SIZE, 1);
-            for (int i = concat_start_token_pos; i < token_vec_len(tokens); i++) {
-                token *t = token_vec_get(tokens, i);
-                strcat(buf, file_get_part(t->src_id, t->src_pos, t->src_end_pos));
+            lex_token();
+            token *t = token_vec_top(ctx->tokens);
+            if (t->id == T_IDENT) {
+                macro_t *m = find_macro(t->str_value);
+                if (m) {
+                    token name = *token_vec_pop(ctx->tokens);
+                    if (!expand_source_macro(m, ctx->tokens)) {
+                        token_vec_push(ctx->tokens, name);
+                    }
+                }
             }
-            buf = realloc(buf, strlen(buf)+1);
-
-            while (token_vec_len(tokens) - 1 > concat_start_token_pos) token_vec_pop(tokens); // reset concatinated tokens!
-            concat_start_token_pos = -1;
-
-            enter_new_file(src->filename, buf, 0, strlen(buf), 1, 1);
-            tokenize();
-            exit_file();
         }
         skip();
     }
+
+    if (guard_state == GUARD_CLOSED && ctx->src->path && !get_include_guard(ctx->src->path)) {
+        debug("include guard %s found in %s", guard, ctx->src->path);
+        add_include_guard(ctx->src->path, guard);
+    }
 }
 
 void tokenize_file(char *filename) {
-    tokens = token_vec_new();
+    ctx->tokens = token_vec_new();
+    ctx->ifdef_skips = bool_vec_new();
+    ctx->macro_params = char_p_vec_new();
+    init_keywords();
     enter_file(filename);
 
-    enter_file("rcc/args.h");  // defines __builtin_va_* macros
-    tokenize();
-    exit_file();
+    include_file("rcc/args.h");  // defines __builtin_va_* macros
 
     tokenize();
     add_token(T_EOF);
     exit_file();
-    debug("tokens:%d", token_vec_len(tokens));
+    info("tokens:%d identifiers:%d", token_vec_len(ctx->tokens), intern_count());
 }
 
 bool expect(token_id id) {
-    if (token_vec_get(tokens, token_pos)->id == id) {
-        token_pos++;
+    if (token_vec_get(ctx->tokens, ctx->token_pos)->id == id) {
+        ctx->token_pos++;
         return TRUE;
     }
     return FALSE;
 }
 
 bool expect_int(int *value) {
-    if (token_vec_get(tokens, token_pos)->id == T_UINT32) {
-        *value = token_vec_get(tokens, token_pos)->int_value;
-        token_pos++;
+    if (token_vec_get(ctx->tokens, ctx->token_pos)->id == T_UINT32) {
+        *value = token_vec_get(ctx->tokens, ctx->token_pos)->int_value;
+        ctx->token_pos++;
         return TRUE;
     }
     return FALSE;
 }
 
 bool expect_long(long *value) {
-    if (token_vec_get(tokens, token_pos)->id == T_UINT64) {
-        *value = token_vec_get(tokens, token_pos)->long_value;
-        token_pos++;
+    if (token_vec_get(ctx->tokens, ctx->token_pos)->id == T_UINT64) {
+        *value = token_vec_get(ctx->tokens, ctx->token_pos)->long_value;
+        ctx->token_pos++;
         return TRUE;
     }
     return FALSE;
 }
 
 bool expect_ident(char **value) {
-    if (token_vec_get(tokens, token_pos)->id == T_IDENT) {
-        *value = token_vec_get(tokens, token_pos)->str_value;
-        token_pos++;
+    if (token_vec_get(ctx->tokens, ctx->token_pos)->id == T_IDENT) {
+        *value = token_vec_get(ctx->tokens, ctx->token_pos)->str_value;
+        ctx->token_pos++;
         return TRUE;
     }
     return FALSE;
 }
 
 bool expect_string(char **value) {
-    if (token_vec_get(tokens, token_pos)->id == T_STRING) {
-        *value = token_vec_get(tokens, token_pos)->str_value;
-        token_pos++;
+    if (token_vec_get(ctx->tokens, ctx->token_pos)->id == T_STRING) {
+        *value = token_vec_get(ctx->tokens, ctx->token_pos)->str_value;
+        ctx->token_pos++;
         return TRUE;
     }
     return FALSE;
 }
 
 bool expect_char(char *value) {
-    if (token_vec_get(tokens, token_pos)->id == T_CHAR) {
-        *value = token_vec_get(tokens, token_pos)->char_value;
-        token_pos++;
+    if (token_vec_get(ctx->tokens, ctx->token_pos)->id == T_CHAR) {
+        *value = token_vec_get(ctx->tokens, ctx->token_pos)->char_value;
+        ctx->token_pos++;
         return TRUE;
     }
     return FALSE;
 }
 
 int get_token_pos() {
-    return token_pos;
+    return ctx->token_pos;
 }
 
 void set_token_pos(int pos) {
-    token_pos = pos;
+    ctx->token_pos = pos;
 }
 
 bool is_eot() {
-    return (token_pos >= token_vec_len(tokens));
+    return (ctx->token_pos >= token_vec_len(ctx->tokens));
 }
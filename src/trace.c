@@ -0,0 +1,103 @@
+#include "types.h"
+#include "rsys.h"
+#include "arena.h"
+#include "rstring.h"
+#include "devtool.h"
+#include "vec.h"
+#include "map.h"
+
+#include "stats.h"
+#include "trace.h"
+
+#include "token.h"
+#include "file.h"
+#include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
+#define O_CREAT 0x40
+#define O_TRUNC 0x200
+#define O_WRONLY 1
+#define O_APPEND 0x400
+
+/*
+ * every event but the first one written by trace_open() starts with a comma,
+ * so that the array stays valid JSON whichever process writes last
+ */
+int trace_open(char *path) {
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_APPEND, 0644);
+    if (fd == -1) {
+        error("cannot open trace file: %s", path);
+    }
+    char buf[RCC_BUF_SIZE];
+    snprintf(buf, RCC_BUF_SIZE, "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"rcc\"}}", getpid());
+    write(fd, buf, strlen(buf));
+    ctx->trace_fd = fd;
+    return fd;
+}
+
+void trace_write(char *event) {
+    int len = strlen(event);
+    if (ctx->trace_len + len > TRACE_BUF_SIZE) {
+        trace_flush();
+    }
+    memcpy(ctx->trace_buf + ctx->trace_len, event, len);
+    ctx->trace_len += len;
+}
+
+void trace_source(char *filename) {
+    if (!ctx->trace_fd) {
+        return;
+    }
+    ctx->trace_pid = getpid();
+    if (!ctx->trace_buf) {
+        ctx->trace_buf = arena_alloc(TRACE_BUF_SIZE);
+    }
+    char buf[RCC_BUF_SIZE];
+    snprintf(buf, RCC_BUF_SIZE, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":", ctx->trace_pid);
+    append_json_string(buf, RCC_BUF_SIZE - 2, filename); // room for the closing braces
+    strcat(buf, "}}");
+    trace_write(buf);
+}
+
+void trace_begin(char *category, char *name) {
+    if (!ctx->trace_fd) {
+        return;
+    }
+    char buf[RCC_BUF_SIZE];
+    strcpy(buf, ",\n{\"name\":");
+    append_json_string(buf, RCC_BUF_SIZE / 2, name); // the rest of the event fits in the other half
+    long len = strlen(buf);
+    snprintf(buf + len, RCC_BUF_SIZE - len, ",\"cat\":\"%s\",\"ph\":\"B\",\"pid\":%d,\"tid\":1,\"ts\":%ld}", category, ctx->trace_pid, stats_clock());
+    trace_write(buf);
+}
+
+void trace_end() {
+    if (!ctx->trace_fd) {
+        return;
+    }
+    char buf[RCC_BUF_SIZE];
+    snprintf(buf, RCC_BUF_SIZE, ",\n{\"ph\":\"E\",\"pid\":%d,\"tid\":1,\"ts\":%ld}", ctx->trace_pid, stats_clock());
+    trace_write(buf);
+}
+
+void trace_flush() {
+    if (!ctx->trace_fd || ctx->trace_len == 0) {
+        return;
+    }
+    if (write(ctx->trace_fd, ctx->trace_buf, ctx->trace_len) != ctx->trace_len) {
+        warning("cannot write the trace");
+    }
+    ctx->trace_len = 0;
+}
+
+void trace_close(int fd) {
+    write(fd, "\n]\n", 3);
+    close(fd);
+}
@@ -1,44 +1,48 @@
 #include "types.h"
 #include "rsys.h"
+#include "arena.h"
 #include "rstring.h"
 #include "devtool.h"
 #include "vec.h"
+#include "intern.h"
+#include "map.h"
 
+#include "token.h"
+#include "file.h"
 #include "type.h"
+#include "var.h"
+#include "func.h"
+#include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
 
-VEC_HEADER(type_t, type_vec)
-VEC_BODY(type_t, type_vec)
-
-VEC_BODY(member_t, member_vec)
 
-type_vec types = 0;
+VEC_BODY(type_t, type_vec)
 
-type_t *type_int;
-type_t *type_void;
-type_t *type_char;
-type_t *type_long;
-type_t *type_void_ptr;
-type_t *type_char_ptr;
+VEC_INLINE_BODY(member_t, member_vec)
 
 void init_types() {
     add_type("$*", 8, 0, -1);    // for pointer
-    type_void = add_type("void", 0, 0, -1);
-    type_int = add_type("int", 4, 0, -1);
-    type_char = add_type("char", 1, 0, -1);
-    type_long = add_type("long", 8, 0, -1);
+    ctx->type_void = add_type("void", 0, 0, -1);
+    ctx->type_int = add_type("int", 4, 0, -1);
+    ctx->type_char = add_type("char", 1, 0, -1);
+    ctx->type_long = add_type("long", 8, 0, -1);
 
-    type_void_ptr = add_pointer_type(type_void);
-    type_char_ptr = add_pointer_type(type_char);
+    ctx->type_void_ptr = add_pointer_type(ctx->type_void);
+    ctx->type_char_ptr = add_pointer_type(ctx->type_char);
 }
 
 char *dump_type(type_t *t) {
     type_t *t_org = t;
 
-    char *buf = calloc(RCC_BUF_SIZE, 1);
+    char buf[RCC_BUF_SIZE];
+    buf[0] = '\0';
 
     if (!t) {
-        strcat(buf, "?");
-        return realloc(buf, strlen(buf));
+        return "?";
     }
     while (t && t->ptr_to) {
         if (t->array_length > 0) {
@@ -66,23 +70,34 @@ char *dump_type(type_t *t) {
     }
     snprintf(buf+strlen(buf), RCC_BUF_SIZE, " size:%d", type_size(t_org));
 
-    return realloc(buf, strlen(buf));;
+    return arena_strdup(buf);
 }
 
 type_t *add_type(char* name, int size, type_t *ptr_to, int array_length) {
-    if (!types) types = type_vec_new();
+    if (!ctx->types) {
+        ctx->types = type_vec_new();
+        ctx->type_names = str_map_new();
+    }
 
     type_t t;
-    t.name = name;
+    t.name = intern(name);
     t.size = size;
     t.ptr_to = ptr_to;
     t.array_length = array_length;
     t.enum_of = (void *)0;
     t.struct_of = (void *)0;
     t.typedef_of = (void *)0;
+    t.pointer_type = (void *)0;
+    t.array_types = (void *)0;
+    t.next_array = (void *)0;
 
-    type_t *t_ptr = type_vec_push(types, t);
-    debug("added type:%s", dump_type(t_ptr));
+    type_t *t_ptr = type_vec_push(ctx->types, t);
+    if (!str_map_get(ctx->type_names, t_ptr->name)) {
+        str_map_put(ctx->type_names, t_ptr->name, t_ptr); // the first type with the name wins
+    }
+    if (log_level >= LOG_DEBUG) {
+        debug("added type:%s", dump_type(t_ptr));
+    }
 
     return t_ptr;
 }
@@ -95,66 +110,47 @@ type_t *add_typedef(char *name, type_t* t) {
     return defined_type;
 }
 
-type_t *find_pointer(type_t *ptr_to, int array_length) {
-    for (int i=0; i<type_vec_len(types); i++) {
-        type_t *t = type_vec_get(types, i);
-        if (t->ptr_to == ptr_to && t->array_length == array_length) {
-            return t;
-        }
-    }
-    return 0;
-}
-
 type_t *add_pointer_type(type_t *t) {
-    type_t *p = find_pointer(t, -1);
-    if (!p) {
+    t = type_unalias(t);
+    if (!t->pointer_type) {
         int size = 8;
-        p = add_type("", size, t, -1);
+        t->pointer_type = add_type("", size, t, -1);
     }
-    return p;
+    return t->pointer_type;
 }
 
 type_t *add_array_type(type_t *t, int array_length) {
-    type_t *p = find_pointer(t, array_length);
-    if (!p) {
-        int size = array_length * type_size(t);
-        p = add_type("", align(size, 4), t, array_length);
+    t = type_unalias(t);
+    for (type_t *p = t->array_types; p; p = p->next_array) {
+        if (p->array_length == array_length) {
+            return p;
+        }
     }
+    int size = array_length * type_size(t);
+    type_t *p = add_type("", align(size, 4), t, array_length);
+    p->next_array = t->array_types;
+    t->array_types = p;
     return p;
 }
 
 type_t *find_type(char *name) {
-    for (int i=0; i<type_vec_len(types); i++) {
-        type_t *t = type_vec_get(types, i);
-        if (!strcmp(name, t->name)) {
-            return t;
-        }
-    }
-    return 0;
+    if (!ctx->type_names) return 0;
+    return str_map_get(ctx->type_names, name);
 }
 
-VEC_HEADER(struct_t, struct_vec)
 VEC_BODY(struct_t, struct_vec)
 
-struct_vec structs = 0;
-
 type_t *find_struct_type(char *name, bool is_union) {
-    for (int i=0; i<type_vec_len(types); i++) {
-        type_t *t = type_vec_get(types, i);
-        if (t->struct_of && t->typedef_of == 0) {
-            struct_t *s = t->struct_of;
-            if (!s->is_anonymous 
-                && !strcmp(name, s->name) 
-                && s->is_union == is_union) {
-                return t;
-            }
-        }
-    }
-    return 0;
+    if (!ctx->structs) return 0;
+    return str_map_get(is_union ? ctx->union_names : ctx->struct_names, name);
 }
 
 type_t *add_struct_union_type(char *name, bool is_union, bool is_anonymous) {
-    if (!structs) structs = struct_vec_new();
+    if (!ctx->structs) {
+        ctx->structs = struct_vec_new();
+        ctx->struct_names = str_map_new();
+        ctx->union_names = str_map_new();
+    }
 
     type_t *t = (void *)0;
     if (!is_anonymous) {
@@ -164,14 +160,17 @@ type_t *add_struct_union_type(char *name, bool is_union, bool is_anonymous) {
         }
     }
     struct_t s;
-    s.name = is_anonymous? "annonymous" : name;
+    s.name = intern(is_anonymous? "annonymous" : name);
     s.members = member_vec_new();
     s.is_union = is_union;
     s.is_anonymous = is_anonymous;
     s.next_offset = 0;
 
     t = add_type("$s", 0, 0, -1);
-    t->struct_of = struct_vec_push(structs, s);
+    t->struct_of = struct_vec_push(ctx->structs, s);
+    if (!is_anonymous) {
+        str_map_put(is_union ? ctx->union_names : ctx->struct_names, t->struct_of->name, t);
+    }
     return t;
 }
 
@@ -196,7 +195,7 @@ member_t *add_struct_member(type_t *st, char *name, type_t *t, bool is_union) {
         error("adding member to non struct type: %s", st->name);
     }
     member_t m;
-    m.name = name;
+    m.name = intern(name);
     m.t = t;
 
     // todo: alignment to 4 bytes
@@ -223,37 +222,28 @@ member_t *find_struct_member(type_t *t, char *name) {
     }
     for (int i=0; i<member_vec_len(s->members); i++) {
         member_t *m = member_vec_get(s->members, i);
-        if (!strcmp(name, m->name)) {
+        if (name == m->name) {
             return m;
         }
     }
     return 0;
 }
 
-VEC_HEADER(enum_t, enum_vec)
 VEC_BODY(enum_t, enum_vec)
 
-enum_vec enums = 0;
-
 type_t *find_enum_type(char *name) {
     // annonymous enum should be different in every occurence
-    if (strlen(name) == 0) {
+    if (strlen(name) == 0 || !ctx->enums) {
         return 0; 
     }
-
-    for (int i=0; i<type_vec_len(types); i++) {
-        type_t *t = type_vec_get(types, i);
-        if (t->enum_of && t->typedef_of == 0) {
-            if (!strcmp(name, t->enum_of->name)) {
-                return t;
-            }
-        }
-    }
-    return 0;
+    return str_map_get(ctx->enum_names, name);
 }
 
 type_t *add_enum_type(char *name) {
-    if (!enums) enums = enum_vec_new();
+    if (!ctx->enums) {
+        ctx->enums = enum_vec_new();
+        ctx->enum_names = str_map_new();
+    }
 
     type_t *t = find_enum_type(name);
     if (t) {
@@ -262,11 +252,14 @@ type_t *add_enum_type(char *name) {
 
     enum_t e;
     e.next_value = 0;
-    e.name = name;
+    e.name = intern(name);
     debug("added new enum type: ", name);
 
     t = add_type("$e", 4, 0, -1);
-    t->enum_of = enum_vec_push(enums, e);
+    t->enum_of = enum_vec_push(ctx->enums, e);
+    if (strlen(name) > 0) {
+        str_map_put(ctx->enum_names, t->enum_of->name, t);
+    }
 
     return t;
 }
@@ -284,12 +277,7 @@ int type_size(type_t *t) {
 
 bool type_is_same(type_t *to, type_t *from) {
     if (!to || !from) return FALSE;
-    to = type_unalias(to);
-    from = type_unalias(from);
-    if (to == from) return TRUE;
-    if (to->array_length != from->array_length) return FALSE;
-    if (to->ptr_to && from->ptr_to && type_is_same(to->ptr_to, from->ptr_to)) return TRUE;
-    return FALSE;
+    return type_unalias(to) == type_unalias(from); // derived types are hash-consed
 }
 
 bool type_is_convertable(type_t *to, type_t *from) {
@@ -298,7 +286,7 @@ bool type_is_convertable(type_t *to, type_t *from) {
     from = type_unalias(from);
     if (to == from) return TRUE;
     if (to->ptr_to && from->ptr_to && type_is_convertable(to->ptr_to, from->ptr_to)) return TRUE;
-    if (to == type_long && (from == type_int || from == type_char)) return TRUE;
-    if (to == type_int && from == type_char) return TRUE;
+    if (to == ctx->type_long && (from == ctx->type_int || from == ctx->type_char)) return TRUE;
+    if (to == ctx->type_int && from == ctx->type_char) return TRUE;
     return FALSE;
 }
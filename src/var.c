@@ -1,26 +1,75 @@
 #include "types.h"
 #include "rsys.h"
+#include "arena.h"
 #include "rstring.h"
 #include "devtool.h"
 #include "vec.h"
+#include "map.h"
+#include "intern.h"
 
+#include "token.h"
+#include "file.h"
 #include "type.h"
 #include "var.h"
 #include "func.h"
 #include "atom.h"
+#include "gstr.h"
+#include "macro.h"
+#include "pch.h"
+#include "emit.h"
+#include "context.h"
+
 
-VEC_HEADER(frame_t, frame_vec)
 VEC_BODY(frame_t, frame_vec)
 
-VEC_BODY(var_t, var_vec)
+VEC_INLINE_BODY(var_t, var_vec)
+
+var_t *binding_var(binding_t *b) {
+    return var_vec_get(frame_vec_get(ctx->env, b->frame_pos)->vars, b->var_index);
+}
 
-frame_vec env = 0;
-int max_offset = 0;
+// binds the last variable in the top frame
+void bind_var(frame_t *f) {
+    int frame_pos = frame_vec_len(ctx->env) - 1;
+    int var_index = var_vec_len(f->vars) - 1;
+    char *name = var_vec_get(f->vars, var_index)->name;
+    binding_t *outer = str_map_get(ctx->bindings, name);
+    if (outer && outer->frame_pos == frame_pos) {
+        return; // the first declaration in a frame wins
+    }
+    binding_t *b = ctx->free_bindings;
+    if (b) {
+        ctx->free_bindings = b->shadowed;
+    } else {
+        b = arena_alloc(sizeof(binding_t));
+    }
+    b->frame_pos = frame_pos;
+    b->var_index = var_index;
+    b->shadowed = outer;
+    str_map_put(ctx->bindings, name, b);
+}
+
+void unbind_frame(frame_t *f, int frame_pos) {
+    for (int i=0; i<var_vec_len(f->vars); i++) {
+        char *name = var_vec_get(f->vars, i)->name;
+        binding_t *b = str_map_get(ctx->bindings, name);
+        if (!b || b->frame_pos != frame_pos) {
+            continue; // already restored for a duplicated name
+        }
+        if (b->shadowed) {
+            str_map_put(ctx->bindings, name, b->shadowed);
+        } else {
+            str_map_delete(ctx->bindings, name);
+        }
+        b->shadowed = ctx->free_bindings;
+        ctx->free_bindings = b;
+    }
+}
 
 void dump_env() {
     debug("env ----");
-    for (int pos = frame_vec_len(env) - 1; pos >= 0; pos--) {
-        frame_t *f = frame_vec_get(env, pos);
+    for (int pos = frame_vec_len(ctx->env) - 1; pos >= 0; pos--) {
+        frame_t *f = frame_vec_get(ctx->env, pos);
         debug("env[%d] vars:%d offset:%d", pos, var_vec_len(f->vars), f->offset);
         for (int i=0; i<var_vec_len(f->vars); i++) {
             var_t *v = var_vec_get(f->vars, i);
@@ -31,18 +80,35 @@ void dump_env() {
 }
 
 void _enter_var_frame(bool is_function_args) {
-    if (!env) env = frame_vec_new();
+    if (!ctx->env) {
+        ctx->env = frame_vec_new();
+        ctx->bindings = str_map_new();
+        ctx->block_vars = vec_new();
+    }
 
-    int env_top = frame_vec_len(env);
+    int env_top = frame_vec_len(ctx->env);
     debug("entering frame:%d", env_top);
 
     frame_t f;
-    f.vars = var_vec_new();
-    f.offset = (env_top == 0) ? 0 : frame_vec_get(env, env_top - 1)->offset;
+    if (is_function_args) {
+        f.vars = var_vec_new(); // kept by the function
+    } else {
+        // one block frame is alive at a depth at a time, so the vars of an exited one are reused
+        while (vec_len(ctx->block_vars) <= env_top) {
+            vec_push(ctx->block_vars, NULL);
+        }
+        void **vars = vec_get(ctx->block_vars, env_top);
+        if (!*vars) {
+            *vars = var_vec_new();
+        }
+        f.vars = *vars;
+        f.vars->len = 0;
+    }
+    f.offset = (env_top == 0) ? 0 : frame_vec_get(ctx->env, env_top - 1)->offset;
     f.is_function_args = is_function_args;
     f.num_reg_vars = 0;
     f.num_stack_vars = 0;
-    frame_vec_push(env, f);
+    frame_vec_push(ctx->env, f);
 }
 
 void enter_function_args_var_frame() {
@@ -54,49 +120,50 @@ void enter_var_frame() {
 }
 
 void exit_var_frame() {
-    int env_top = frame_vec_len(env) - 1;
+    int env_top = frame_vec_len(ctx->env) - 1;
     debug("exiting frame:%d", env_top);
     if (env_top < 0) {
         error("Invalid frame_t exit");
     }
-    frame_vec_pop(env);
+    unbind_frame(frame_vec_pop(ctx->env), env_top);
 }
 
 int var_max_offset() {
-    return max_offset;
+    return ctx->max_offset;
 }
 
 void reset_var_max_offset() {
-    max_offset = 0;
+    ctx->max_offset = 0;
 }
 
 frame_t *get_top_frame() {
-    if (frame_vec_len(env) == 0) {
+    if (frame_vec_len(ctx->env) == 0) {
         error("empty environment");
     }
-    return frame_vec_top(env);
+    return frame_vec_top(ctx->env);
 }
 
 frame_t *get_global_frame() {
-    if (frame_vec_len(env) == 0) {
+    if (frame_vec_len(ctx->env) == 0) {
         error("empty global environment");
     }
-    return frame_vec_get(env, 0);
+    return frame_vec_get(ctx->env, 0);
 }
 
-
 var_t *add_constant_int(char *name, type_t*t, int value) {
     var_t v;
-    v.name = name;
+    v.name = intern(name);
     v.t = t;
     v.is_constant = TRUE;
-    v.is_global = (frame_vec_len(env) == 1);
+    v.is_global = (frame_vec_len(ctx->env) == 1);
     v.has_value = TRUE;
     v.int_value = value;
     debug("add_constant_int: added %d", v.int_value);
 
     frame_t *f = get_top_frame();
-    return var_vec_push(f->vars, v);
+    var_t *v_ptr = var_vec_push(f->vars, v);
+    bind_var(f);
+    return v_ptr;
 }
 
 void var_realloc(var_t *v, type_t *t) {
@@ -106,8 +173,8 @@ void var_realloc(var_t *v, type_t *t) {
 
     frame_t *f = get_top_frame();
     f->offset += align(type_size(t), 4);
-    if (f->offset > max_offset) {
-        max_offset = f->offset;
+    if (f->offset > ctx->max_offset) {
+        ctx->max_offset = f->offset;
     }
     v->offset = f->offset;
     v->t = t;
@@ -116,30 +183,31 @@ void var_realloc(var_t *v, type_t *t) {
 void add_register_save_area() {
     frame_t *f = get_top_frame();
     f->offset = align(f->offset, ALIGN_OF_STACK) + ABI_REG_SAVE_AREA_SIZE;
-    if (f->offset > max_offset) {
-        max_offset = f->offset;
+    if (f->offset > ctx->max_offset) {
+        ctx->max_offset = f->offset;
     }
 }
 
 var_t *add_var(char *name, type_t *t) {
     frame_t *f = get_top_frame();
     var_t v;
+    ctx->vars_added++;
 
-    v.name = name;
+    v.name = intern(name);
     v.t = t;
     v.is_global = FALSE;
     v.is_constant = FALSE;
     v.is_external = FALSE;
     v.has_value = FALSE;
 
-    if (frame_vec_len(env) == 1) {
+    if (frame_vec_len(ctx->env) == 1) {
         v.offset = 0;
         v.is_global = TRUE;
     } else if (f->is_function_args && t->struct_of) {
         int size = type_size(t);
         if (size <= 16 && f->num_reg_vars < ABI_NUM_GP - 2) {
             f->offset += align(type_size(t), 8);
-            max_offset = max(f->offset, max_offset);
+            ctx->max_offset = max(f->offset, ctx->max_offset);
             v.offset = f->offset;
             f->num_reg_vars += (size > 8) ? 2 : 1;
         } else {
@@ -151,38 +219,37 @@ var_t *add_var(char *name, type_t *t) {
         f->num_stack_vars++;
     } else {
         f->offset += align(type_size(t), 4);
-        max_offset = max(f->offset, max_offset);
+        ctx->max_offset = max(f->offset, ctx->max_offset);
         v.offset = f->offset;
         f->num_reg_vars++;
     }
 
     var_t *v_ptr = var_vec_push(f->vars, v);
-    debug("add_var:'%s' frame[%d] offset:%d type:%s", name, frame_vec_len(env)-1, v.offset, dump_type(t));
+    bind_var(f);
+    if (log_level >= LOG_DEBUG) {
+        debug("add_var:'%s' frame[%d] offset:%d type:%s", name, frame_vec_len(ctx->env)-1, v.offset, dump_type(t));
+    }
 
     return v_ptr;
 }
 
 var_t *find_var_in_current_frame(char *name) {
-    frame_t *f = get_top_frame();
-    for (int i=0; i<var_vec_len(f->vars); i++) {
-        var_t *v = var_vec_get(f->vars, i);
-        if (!strcmp(name, v->name)) {
-            return v;
-        }
+    get_top_frame();
+    binding_t *b = str_map_get(ctx->bindings, name);
+    if (!b || b->frame_pos != frame_vec_len(ctx->env) - 1) {
+        return 0;
     }
-    return 0;
+    return binding_var(b);
 }
 
 var_t *find_var(char *name) {
-    for (int env_pos = frame_vec_len(env) - 1; env_pos >= 0; env_pos--) {
-        frame_t *f = frame_vec_get(env, env_pos);
-        for (int i=0; i<var_vec_len(f->vars); i++) {
-            var_t *v = var_vec_get(f->vars, i);
-            if (!strcmp(name, v->name)) {
-                return v;
-            }
-        }
+    if (!ctx->bindings) {
+        return 0;
+    }
+    binding_t *b = str_map_get(ctx->bindings, name);
+    if (!b) {
+        return 0;
     }
-    return 0;
+    return binding_var(b);
 }
 
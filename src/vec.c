@@ -1,4 +1,5 @@
 #include "rsys.h"
+#include "arena.h"
 #include "vec.h"
 
 VEC_BODY(char, char_vec)
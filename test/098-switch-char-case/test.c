@@ -0,0 +1,15 @@
+int code(int c) {
+    switch (c) {
+    case '(': return 1;
+    case '{': return 2;
+    case 'z': return 3;
+    default: return 0;
+    }
+}
+
+int main() {
+    int garbage = 0x12345600;
+    int c = garbage | '{';
+    c = c & 0xff;
+    return code('(') + code(c) * 4 + code('z') * 16 + code('a') * 64;
+}
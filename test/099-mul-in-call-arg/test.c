@@ -0,0 +1,23 @@
+typedef struct {
+    int kind;
+    char *name;
+    int value;
+} item_t;
+
+int id(int a) {
+    return a;
+}
+
+int main() {
+    item_t items[4];
+    for (int i=0; i<4; i++) {
+        items[i].value = i + 1;
+    }
+    item_t *p = items;
+    int r = 0;
+    for (int j=0; j<2; j++) {
+        int v = id((p+j+1)->value); // the scaled index is computed in %rdx
+        r = r * 10 + v % id(j + 5);
+    }
+    return r;
+}
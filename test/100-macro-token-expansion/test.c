@@ -0,0 +1,18 @@
+#define EMPTY
+#define ZERO() 0
+#define ADD(a,b) ((a)+(b))
+#define TWICE(a) ADD(a,a)
+#define NAME(a,b) a##b
+#define STR "a,(b"
+
+int main() {
+  int xy = 3;
+  int y = 5;
+  int ADD = 4;
+  int r = EMPTY ZERO();
+  r += ADD(ADD(1,2), TWICE(3));
+  r += NAME(x,y) + NAME(,y) + ADD;
+  char *s = STR;
+  if (ADD(s[2], 0) != '(') return 1;
+  return r;
+}
@@ -0,0 +1,5 @@
+#ifndef GUARD_H
+#define GUARD_H
++ 1
+#endif
+// only comments after #endif
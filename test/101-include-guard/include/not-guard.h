@@ -0,0 +1,4 @@
+#ifndef NOT_GUARD_H
+#define NOT_GUARD_H
+#endif
++ 32
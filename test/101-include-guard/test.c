@@ -0,0 +1,15 @@
+int main() {
+  int n = 0
+#include "guard.h"
+#include "guard.h"
+#include "once.h"
+#include "once.h"
+#include "plain.h"
+#include "plain.h"
+#include "not-guard.h"
+#include "not-guard.h"
+#undef GUARD_H
+#include "guard.h"
+  ;
+  return n;
+}
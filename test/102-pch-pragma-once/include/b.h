@@ -0,0 +1,3 @@
+#pragma once
+int b_var = 7;
+int b_twice(int x) { return x * 2; }
@@ -0,0 +1,5 @@
+#include "b.h"
+#include "a.h"
+int main() {
+  return 0;
+}
@@ -0,0 +1,6 @@
+// with --pch, pre.c has cached a.h with b.h skipped as included already
+#include "a.h"
+int main() {
+  print(b_twice(b_var));
+  return 0;
+}
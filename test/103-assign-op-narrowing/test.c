@@ -0,0 +1,14 @@
+int main() {
+  int keep = 5;
+  int n = 1;
+  char c = 2;
+  long l = 10;
+  n += l;
+  n -= l + 3;
+  n *= l;
+  c += l;
+  print(n);
+  print(c);
+  print(keep);
+  return 0;
+}
@@ -0,0 +1 @@
+#include "once.h"
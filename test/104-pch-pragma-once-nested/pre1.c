@@ -0,0 +1,5 @@
+// caches a.h with once.h not included yet
+#include "a.h"
+int main() {
+  return 0;
+}
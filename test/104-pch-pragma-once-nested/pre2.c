@@ -0,0 +1,6 @@
+// the cache of a.h is not usable with once.h included: outer.h is cached with a.h lexed again
+#include "once.h"
+#include "outer.h"
+int main() {
+  return 0;
+}
@@ -0,0 +1,7 @@
+// with --pch, outer.h must not be replayed without once.h
+#include "outer.h"
+int main() {
+  once_var = 3;
+  print(once_var);
+  return 0;
+}
@@ -16,7 +16,14 @@ function fatal {
     true
 }
 
+# a test may have pre*.c, compiled first in the order of their names by the same compiler,
+# e.g. to fill the cache of --pch
 function compile {
+    for pre in $(dirname $1)/pre*.c; do
+        if [ -f $pre ]; then
+            $CC -S -I$(dirname $1)/include -I../include -o out/pre.s $pre 2>$DEBUG_LOG || return 1
+        fi
+    done
     $CC -S -I$(dirname $1)/include -I../include -o $DEBUG_ASM $1 2>$DEBUG_LOG \
     && ( $GCC -o $DEBUG_BIN $DEBUG_ASM print.c || fatal " cannot build test program in $CC" )
 }
@@ -67,7 +74,7 @@ DEBUG_ASM=out/test.s
 EXIT_ON_ERROR=0
 
 function all {
-    for t in 0*; do
+    for t in [0-9]*; do
         run $t
     done
 }
@@ -87,6 +94,31 @@ if [ "$1" = "--gcc" ]; then
   shift
 fi
 
+if [ "$1" = "--server" ]; then
+  # every test compiled by one server, through the client
+  SOCKET=/tmp/rcc-test-$$.sock
+  $CC --server $SOCKET --pch /tmp/rcc-test-$$.pch &
+  SERVER_PID=$!
+  trap "kill $SERVER_PID; rm -rf $SOCKET /tmp/rcc-test-$$.pch" EXIT
+  while [ ! -S $SOCKET ]; do sleep 0.1; done
+  CC="$CC --client $SOCKET"
+  shift
+fi
+
+if [ "$1" = "--stream" ]; then
+  # every function emitted as soon as it is parsed
+  CC="$CC --stream"
+  shift
+fi
+
+if [ "$1" = "--pch" ]; then
+  # the included files cached in a directory shared by every test
+  PCH_DIR=/tmp/rcc-test-$$.pch
+  trap "rm -rf $PCH_DIR" EXIT
+  CC="$CC --pch $PCH_DIR"
+  shift
+fi
+
 if [ "$1" = "--exit-on-error" ]; then
   EXIT_ON_ERROR=1
   shift
@@ -0,0 +1,69 @@
+#include "types.h"
+#include "arena.h"
+
+extern int printf(const char *, ...);
+extern int strcmp(const char *, const char *);
+extern void exit(int);
+extern void *context_new();
+extern void *context_use(void *);
+
+void assert_eq_str(const char *a, const char *b) {
+    if (strcmp(a,b) != 0) {
+        printf("expected:%s actual:%s\n", a, b);
+        exit(-1);
+    }
+}
+
+void assert_eq_int(int a, int b) {
+    if (a != b) {
+        printf("expected:%d actual:%d\n", a, b);
+        exit(-1);
+    }
+}
+
+int main() {
+    context_use(context_new());
+    char *a = arena_alloc(3);
+    char *b = arena_alloc(1);
+    assert_eq_int(8, b - a);
+    assert_eq_int(0, (long)b & 7);
+    assert_eq_int(0, a[0] | a[1] | a[2] | b[0]);
+    assert_eq_int(16, arena_allocated());
+    assert_eq_int(1, arena_chunk_count());
+
+    char *s = arena_strdup("hello");
+    assert_eq_str("hello", s);
+
+    // fill the current chunk up; the next allocation opens a new one
+    for (int i=0; i<ARENA_CHUNK_SIZE / 1024; i++) {
+        arena_alloc(1024);
+    }
+    assert_eq_int(2, arena_chunk_count());
+
+    // a large allocation gets its own chunk and keeps the current one
+    char *big = arena_alloc(ARENA_CHUNK_SIZE);
+    big[ARENA_CHUNK_SIZE - 1] = 1;
+    assert_eq_int(3, arena_chunk_count());
+    char *c = arena_alloc(8);
+    assert_eq_int(3, arena_chunk_count());
+    assert_eq_int(0, c[0]);
+
+    // the last allocation grows in place; others move
+    c[7] = 'c';
+    assert_eq_int(1, arena_realloc(c, 8, 64) == c);
+    char *d = arena_alloc(8);
+    char *e = arena_realloc(c, 64, 128);
+    assert_eq_int(0, e == c);
+    assert_eq_int('c', e[7]);
+    assert_eq_int(1, d != e);
+
+    // a block of its own chunk is reallocated without a new chunk
+    char *grown = arena_realloc(big, ARENA_CHUNK_SIZE, ARENA_CHUNK_SIZE * 2);
+    assert_eq_int(1, grown[ARENA_CHUNK_SIZE - 1]);
+    assert_eq_int(3, arena_chunk_count());
+
+    arena_release();
+    assert_eq_int(0, arena_chunk_count());
+    assert_eq_int(0, arena_allocated());
+    assert_eq_int(0, arena_alloc(8) == 0);
+}
@@ -0,0 +1,42 @@
+#include "types.h"
+#include "arena.h"
+
+extern int printf(const char *, ...);
+extern void exit(int);
+extern void *context_new();
+extern void *context_use(void *);
+extern void context_free(void *);
+
+void assert_eq_int(long a, long b) {
+    if (a != b) {
+        printf("expected:%ld actual:%ld\n", a, b);
+        exit(-1);
+    }
+}
+
+int main() {
+    void *c1 = context_new();
+    void *c2 = context_new();
+    assert_eq_int(0, (long)context_use(c1));
+
+    arena_alloc(100);
+    assert_eq_int(104, arena_allocated());
+
+    // each context has its own arena
+    assert_eq_int((long)c1, (long)context_use(c2));
+    assert_eq_int(0, arena_allocated());
+    arena_alloc(8);
+    assert_eq_int(8, arena_allocated());
+
+    context_use(c1);
+    assert_eq_int(104, arena_allocated());
+
+    // freeing another context leaves the current one as it is
+    context_free(c2);
+    assert_eq_int((long)c1, (long)context_use(c1));
+    assert_eq_int(104, arena_allocated());
+
+    // freeing the current context leaves none current
+    context_free(c1);
+    assert_eq_int(0, (long)context_use(NULL));
+}
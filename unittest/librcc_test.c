@@ -0,0 +1,81 @@
+#include "types.h"
+#include "devtool.h"
+#include "librcc.h"
+
+extern int printf(const char *, ...);
+extern int strcmp(const char *, const char *);
+extern char *strstr(const char *, const char *);
+extern long strlen(const char *);
+extern void free(void *);
+extern void exit(int);
+extern void *context_use(void *);
+
+void assert_eq_int(long a, long b) {
+    if (a != b) {
+        printf("expected:%ld actual:%ld\n", a, b);
+        exit(-1);
+    }
+}
+
+void assert_contains(const char *s, const char *part) {
+    if (!strstr(s, part)) {
+        printf("expected to contain:%s actual:%s\n", part, s);
+        exit(-1);
+    }
+}
+
+char *add_h = "int add(int a, int b) { return a + b; }\n";
+int resolved = 0;
+
+char *resolve(void *data, const char *name, long *len) {
+    if (strcmp(name, "add.h") != 0) {
+        return NULL;
+    }
+    (*(int *)data)++;
+    *len = strlen(add_h);
+    return add_h;
+}
+
+int main() {
+    char *src = "#include \"add.h\"\nint main() { return add(1, 2); }\n";
+    char *dirs[] = {"include", NULL};
+    rcc_options_t options = {"prog.c", dirs, resolve, &resolved};
+    char *out;
+    long out_len;
+
+    assert_eq_int(0, rcc_compile(src, strlen(src), &options, &out, &out_len));
+    assert_eq_int(1, resolved);
+    assert_eq_int(strlen(out), out_len);
+    assert_contains(out, "add:");
+    assert_contains(out, "main:");
+
+    // nothing is left over from the previous compile
+    char *out2;
+    long out2_len;
+    assert_eq_int(0, rcc_compile(src, strlen(src), &options, &out2, &out2_len));
+    assert_eq_int(2, resolved);
+    assert_eq_int(0, strcmp(out, out2));
+    free(out);
+    free(out2);
+
+    // an error returns the message instead of exiting
+    set_log_level(LOG_NONE);
+    char *bad = "int main() { return undefined_var; }\n";
+    assert_eq_int(1, rcc_compile(bad, strlen(bad), &options, &out, &out_len));
+    assert_contains(out, "invalid expr for return");
+    free(out);
+
+    // includes are not found without the resolver
+    options.include_resolver = NULL;
+    assert_eq_int(1, rcc_compile(src, strlen(src), &options, &out, &out_len));
+    assert_contains(out, "add.h");
+    free(out);
+
+    // the source need not be null-terminated
+    char *two = "int f() { return 1; }\nint g( {";
+    assert_eq_int(0, rcc_compile(two, 22, &options, &out, &out_len));
+    assert_contains(out, "f:");
+    free(out);
+
+    assert_eq_int(0, (long)context_use(NULL));
+}
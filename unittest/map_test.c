@@ -0,0 +1,62 @@
+#include "types.h"
+#include "map.h"
+
+extern int puts(const char *);
+extern int printf(const char *, ...);
+extern int snprintf(char *, long, const char *, ...);
+extern int strcmp(const char *, const char *);
+extern void exit(int);
+extern void *context_new();
+extern void *context_use(void *);
+
+void assert_eq_str(const char *a, const char *b) {
+    if (strcmp(a,b) != 0) {
+        printf("expected:%s actual:%s\n", a, b);
+        exit(-1);
+    }
+}
+
+void assert_eq_int(int a, int b) {
+    if (a != b) {
+        printf("expected:%d actual:%d\n", a, b);
+        exit(-1);
+    }
+}
+
+int main() {
+    context_use(context_new());
+    str_map m = str_map_new();
+    char keys[1000][8];
+    for (int i=0; i<1000; i++) {
+        snprintf(keys[i], 8, "k%d", i);
+        str_map_put(m, keys[i], keys[i]);
+    }
+    assert_eq_int(1000, m->len);
+    assert_eq_str("k999", str_map_get(m, "k999"));
+    assert_eq_int(0, str_map_get(m, "k1000") != 0);
+
+    str_map_put(m, "k10", "replaced");
+    assert_eq_int(1000, m->len);
+    assert_eq_str("replaced", str_map_get(m, "k10"));
+
+    for (int i=0; i<1000; i+=2) {
+        assert_eq_int(TRUE, str_map_delete(m, keys[i]));
+    }
+    assert_eq_int(FALSE, str_map_delete(m, "k0"));
+    assert_eq_int(500, m->len);
+    assert_eq_int(0, str_map_get(m, "k0") != 0);
+    assert_eq_str("k1", str_map_get(m, "k1"));
+
+    // deleted slots are reused without growing the table
+    int cap = m->cap;
+    for (int j=0; j<10; j++) {
+        for (int i=0; i<1000; i+=2) str_map_put(m, keys[i], keys[i]);
+        for (int i=0; i<1000; i+=2) str_map_delete(m, keys[i]);
+    }
+    assert_eq_int(cap, m->cap);
+
+    int count = 0;
+    int iter = 0;
+    while (str_map_next(m, &iter)) count++;
+    assert_eq_int(500, count);
+}
@@ -0,0 +1,47 @@
+#include "types.h"
+#include "stats.h"
+
+extern int printf(const char *, ...);
+extern int strcmp(const char *, const char *);
+extern void exit(int);
+extern void *context_new();
+extern void *context_use(void *);
+
+void assert_eq_str(const char *a, const char *b) {
+    if (strcmp(a,b) != 0) {
+        printf("expected:%s actual:%s\n", a, b);
+        exit(-1);
+    }
+}
+
+void assert_eq_int(long a, long b) {
+    if (a != b) {
+        printf("expected:%ld actual:%ld\n", a, b);
+        exit(-1);
+    }
+}
+
+int main() {
+    char buf[64] = "x:";
+    append_json_string(buf, 64, "a\"b\\c\nd");
+    assert_eq_str("x:\"a\\\"b\\\\c\\u000ad\"", buf);
+
+    // cut short to fit, without splitting an escape
+    char small[12] = "x:";
+    append_json_string(small, 12, "abcdefghij");
+    assert_eq_str("x:\"abcdefg\"", small);
+    small[2] = '\0';
+    append_json_string(small, 12, "ab\n");
+    assert_eq_str("x:\"ab\"", small);
+
+    // off by default: the clock is not read
+    context_use(context_new());
+    assert_eq_int(0, stats_start());
+    stats_phase("parse", 0);
+
+    long t = stats_clock();
+    if (t <= 0 || stats_clock() < t) {
+        printf("clock is not monotonic\n");
+        exit(-1);
+    }
+}
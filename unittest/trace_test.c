@@ -0,0 +1,50 @@
+#include "types.h"
+#include "trace.h"
+
+extern int printf(const char *, ...);
+extern char *strstr(const char *, const char *);
+extern void exit(int);
+extern int open(char *, int, ...);
+extern int read(int, char *, int);
+extern int close(int);
+extern int unlink(char *);
+extern void *context_new();
+extern void *context_use(void *);
+
+void assert_contains(const char *s, const char *part) {
+    if (!strstr(s, part)) {
+        printf("expected to contain:%s actual:%s\n", part, s);
+        exit(-1);
+    }
+}
+
+int main() {
+    char *path = "out/trace_test.json";
+
+    // not open: nothing is recorded
+    context_use(context_new());
+    trace_begin("include", "a.h");
+    trace_end();
+    trace_flush();
+
+    int fd = trace_open(path);
+    trace_source("main.c");
+    trace_begin("include", "a\"b.h");
+    trace_begin("macro", "M");
+    trace_end();
+    trace_end();
+    trace_flush();
+    trace_close(fd);
+
+    char buf[4096] = {0};
+    fd = open(path, 0);
+    read(fd, buf, 4095);
+    close(fd);
+    unlink(path);
+    assert_contains(buf, "[{\"name\":\"process_name\"");
+    assert_contains(buf, "\"args\":{\"name\":\"main.c\"}}");
+    assert_contains(buf, ",\n{\"name\":\"a\\\"b.h\",\"cat\":\"include\",\"ph\":\"B\"");
+    assert_contains(buf, ",\n{\"name\":\"M\",\"cat\":\"macro\",\"ph\":\"B\"");
+    assert_contains(buf, ",\n{\"ph\":\"E\"");
+    assert_contains(buf, "}\n]\n");
+}
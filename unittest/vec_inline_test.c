@@ -0,0 +1,79 @@
+#include "vec_template.h"
+#include "arena.h"
+
+extern int puts(const char *);
+extern int printf(const char *, ...);
+extern void exit(int);
+extern void *context_new();
+extern void *context_use(void *);
+extern void *calloc(long, long);
+extern void *malloc(long);
+extern void *realloc(void *, long);
+extern void *memset(void *, int, long);
+
+typedef struct {
+    int a[16];
+    char c;
+    long b;
+} xyz;
+
+VEC_INLINE_HEADER(int, i_vec)
+VEC_INLINE_BODY(int, i_vec)
+
+VEC_INLINE_HEADER(xyz, xyz_vec)
+VEC_INLINE_BODY(xyz, xyz_vec)
+
+void assert_eq_int(int a, int b) {
+    if (a != b) {
+        printf("expected:%d actual:%d\n", a, b);
+        exit(-1);
+    }
+}
+
+void test_int() {
+    i_vec a = i_vec_new();
+    for (int i=0; i<100; i++) i_vec_push(a, i);
+
+    assert_eq_int(100, a->len);
+    assert_eq_int(128, a->cap);
+    assert_eq_int(99, *i_vec_top(a));
+    assert_eq_int(42, *i_vec_get(a, 42));
+    assert_eq_int(42, a->items[42]); // items are stored inline
+    assert_eq_int(0, i_vec_get(a, 100) != 0);
+
+    i_vec_set(a, 10, -1);
+    assert_eq_int(-1, a->items[10]);
+
+    assert_eq_int(99, *i_vec_pop(a));
+    assert_eq_int(99, i_vec_len(a));
+
+    int *p = i_vec_extend(a, 3);
+    assert_eq_int(0, p[0] + p[1] + p[2]); // extended items are zero-cleared
+    assert_eq_int(102, i_vec_len(a));
+}
+
+void test_struct() {
+    xyz_vec v = xyz_vec_new();
+    xyz x;
+    for (int n=0; n<1000; n++) {
+        for (int i=0; i<16; i++) { x.a[i] = n + i; }
+        x.c = n & 127;
+        x.b = n * 1000000000L;
+        xyz_vec_push(v, x);
+    }
+    assert_eq_int(1000, xyz_vec_len(v));
+    for (int n=0; n<1000; n++) {
+        xyz *y = xyz_vec_get(v, n);
+        assert_eq_int(n + 15, y->a[15]);
+        assert_eq_int(n & 127, y->c);
+        assert_eq_int(1, y->b == n * 1000000000L);
+    }
+    assert_eq_int(999, xyz_vec_top(v)->a[0]);
+}
+
+int main() {
+    context_use(context_new());
+    test_int();
+    test_struct();
+    return 0;
+}
@@ -1,9 +1,12 @@
 #include "vec.h"
+#include "arena.h"
 
 extern int puts(const char *);
 extern int printf(const char *, ...);
 extern int strcmp(const char *, const char *);
 extern void exit(int);
+extern void *context_new();
+extern void *context_use(void *);
 
 typedef struct {
     int a[16];
@@ -38,6 +41,7 @@ void sub(xyz_vec v) {
 }
 
 int main() {
+    context_use(context_new());
     xyz_vec v = xyz_vec_new();
     xyz x;
     for (int i=0; i<10; i++) { x.a[i] = i; }
@@ -4,6 +4,8 @@ extern int puts(const char *);
 extern int printf(const char *, ...);
 extern int strcmp(const char *, const char *);
 extern void exit(int);
+extern void *context_new();
+extern void *context_use(void *);
 
 void assert_eq_str(const char *a, const char *b) {
     if (strcmp(a,b) != 0) {
@@ -20,6 +22,7 @@ void assert_eq_int(int a, int b) {
 }
 
 int main() {
+    context_use(context_new());
     char_p_vec a = char_p_vec_new();
     char_p_vec_push(a, "xyz");
     for (int i=0; i<100; i++) char_p_vec_push(a, "abc");